@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+#include <trusty_std.h>
+#include <lib/perf/perf_stats.h>
+#include <lib/rng/trusty_rng.h>
+
+#include "hwrng_bench.h"
+
+#define LOG_TAG "hwrng_bench"
+
+#define TLOGI(fmt, ...) \
+    fprintf(stderr, "%s: %d: " fmt, LOG_TAG, __LINE__,  ## __VA_ARGS__)
+
+#define HWRNG_BENCH_BYTES   (1024 * 1024)   /* per request size */
+
+/*
+ * Acceptance bounds for chi-square of byte histogram (255 degrees of
+ * freedom) and for z score of bit runs, both roughly p = 0.001 two sided
+ */
+#define HWRNG_CHI2_MIN     185
+#define HWRNG_CHI2_MAX     330
+#define HWRNG_RUNS_Z100    330   /* |z| * 100 */
+
+static const size_t _req_sizes[] = { 16, 64, 256, 1024 };
+
+static uint8_t _buf[1024];
+
+/*
+ * Everything is accumulated on the fly, samples are not kept
+ */
+struct hwrng_quality {
+	uint64_t bytes;
+	uint64_t ones;
+	uint64_t transitions;   /* between adjacent bits, MSB first */
+	uint8_t  last;          /* last byte seen */
+	uint32_t hist[256];
+};
+
+static struct hwrng_quality _total;
+
+static uint popcount8(uint8_t v)
+{
+	return __builtin_popcount(v);
+}
+
+static uint64_t isqrt64(uint64_t v)
+{
+	uint64_t r = 0;
+	uint64_t bit = 1ULL << 62;
+
+	while (bit > v)
+		bit >>= 2;
+	while (bit) {
+		if (v >= r + bit) {
+			v -= r + bit;
+			r = (r >> 1) + bit;
+		} else {
+			r >>= 1;
+		}
+		bit >>= 2;
+	}
+	return r;
+}
+
+static void quality_update(struct hwrng_quality *q, const uint8_t *data,
+			   size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		uint8_t b = data[i];
+
+		q->hist[b]++;
+		q->ones += popcount8(b);
+		/* transitions inside byte and from previous byte's last bit */
+		q->transitions += popcount8((b ^ (b >> 1)) & 0x7f);
+		if (q->bytes || i)
+			q->transitions += ((q->last ^ (b >> 7)) & 1);
+		q->last = b;
+	}
+	q->bytes += len;
+}
+
+/*
+ * Pearson chi-square of byte histogram against uniform distribution,
+ * times 100
+ */
+static uint64_t chi2_x100(const struct hwrng_quality *q)
+{
+	uint64_t exp = q->bytes / 256;
+	uint64_t sum = 0;
+
+	if (!exp)
+		return 0;
+
+	for (uint i = 0; i < 256; i++) {
+		int64_t d = (int64_t)q->hist[i] - (int64_t)exp;
+		sum += (uint64_t)(d * d);
+	}
+	return sum * 100 / exp;
+}
+
+/*
+ * Wald-Wolfowitz runs test on the bit stream, returns z score times 100
+ */
+static int64_t runs_z100(const struct hwrng_quality *q)
+{
+	uint64_t n = q->bytes * 8;
+	uint64_t n1 = q->ones;
+	uint64_t n0 = n - n1;
+	uint64_t runs = q->transitions + 1;
+
+	if (n < 2 || !n0 || !n1)
+		return INT32_MAX;
+
+	/* mu = 1 + 2 n0 n1 / n,  var = (mu - 1)(mu - 2) / (n - 1) */
+	uint64_t mu_1 = 2 * n0 * n1 / n;
+	if (mu_1 < 2)
+		return INT32_MAX;
+	uint64_t sd = isqrt64(mu_1 * (mu_1 - 1) / (n - 1));
+	if (!sd)
+		return INT32_MAX;
+
+	return ((int64_t)runs - (int64_t)(mu_1 + 1)) * 100 / (int64_t)sd;
+}
+
+static int quality_report(const char *name, const struct hwrng_quality *q)
+{
+	int failed = 0;
+	uint64_t chi2 = chi2_x100(q);
+	int64_t z = runs_z100(q);
+	int64_t az = z < 0 ? -z : z;
+	uint32_t hmin = UINT32_MAX;
+	uint32_t hmax = 0;
+
+	for (uint i = 0; i < 256; i++) {
+		hmin = MIN(hmin, q->hist[i]);
+		hmax = MAX(hmax, q->hist[i]);
+	}
+
+	perf_print_value("hwrng", name, "bytes", q->bytes, "B");
+	perf_print_value("hwrng", name, "hist_min", hmin, "samples");
+	perf_print_value("hwrng", name, "hist_max", hmax, "samples");
+	perf_print_value("hwrng", name, "ones",
+			 q->bytes ? q->ones * 1000 / (q->bytes * 8) : 0,
+			 "permille");
+	perf_print_value("hwrng", name, "chi2", chi2, "x100");
+	perf_print_value("hwrng", name, "runs_z", z, "x100");
+
+	if (chi2 < HWRNG_CHI2_MIN * 100 || chi2 > HWRNG_CHI2_MAX * 100) {
+		TLOGI("%s: chi2 %llu.%02llu out of [%d, %d]\n", name,
+		      chi2 / 100, chi2 % 100, HWRNG_CHI2_MIN, HWRNG_CHI2_MAX);
+		failed++;
+	}
+	if (az > HWRNG_RUNS_Z100) {
+		TLOGI("%s: runs z %s%lld.%02lld out of +-%d.%02d\n", name,
+		      z < 0 ? "-" : "", az / 100, az % 100,
+		      HWRNG_RUNS_Z100 / 100, HWRNG_RUNS_Z100 % 100);
+		failed++;
+	}
+	return failed;
+}
+
+static int bench_req_size(size_t req)
+{
+	static struct hwrng_quality q;
+	static struct perf_stats lat;
+	char name[32];
+	int64_t t0, t1, elapsed;
+	int rc;
+
+	memset(&q, 0, sizeof(q));
+	perf_stats_reset(&lat);
+	snprintf(name, sizeof(name), "req%zu", req);
+
+	t0 = perf_now_ns();
+	for (size_t done = 0; done < HWRNG_BENCH_BYTES; done += req) {
+		t1 = perf_now_ns();
+		rc = trusty_rng_hw_rand(_buf, req);
+		perf_stats_add(&lat, perf_now_ns() - t1);
+		if (rc != NO_ERROR) {
+			TLOGI("%zu bytes: trusty_rng_hw_rand returned %d\n",
+			      req, rc);
+			return 1;
+		}
+		quality_update(&q, _buf, req);
+		quality_update(&_total, _buf, req);
+	}
+	elapsed = perf_now_ns() - t0;
+
+	perf_print_value("hwrng", name, "bw",
+			 elapsed > 0 ? q.bytes * 1000000000ULL / 1024 / elapsed : 0,
+			 "KB/s");
+	perf_print_stats("hwrng", name, &lat, "ns");
+
+	return quality_report(name, &q);
+}
+
+int run_hwrng_benchmark(void)
+{
+	int failed = 0;
+
+	TLOGI("hwrng benchmark: %u KB per request size\n",
+	      HWRNG_BENCH_BYTES / 1024);
+
+	memset(&_total, 0, sizeof(_total));
+	for (uint i = 0; i < countof(_req_sizes); i++)
+		failed += bench_req_size(_req_sizes[i]);
+
+	failed += quality_report("total", &_total);
+
+	TLOGI("hwrng benchmark: %d checks failed\n", failed);
+	return failed;
+}
@@ -23,10 +23,19 @@
  * hwkey:
  * - derive twice to same result
  * - derive different, different result
+ * - batch derive same as single derives, per request errors
+ * - async derive same as single derives, completes from wait_any loop
+ * - async derive overlapped with storage reads, same key; time vs serial
+ *   is reported, not asserted
  * - keyslot, invalid slot
+ * - cached derive same as uncached, served from cache
+ * - cached keys dropped on close, evicted when full
  *
  * rng:
+ * - pooled small requests, throughput vs direct calls
  *
+ * Every test is timed into lib/testreg; with WITH_TESTREG the records
+ * are handed to the ipc-unittest collector at the end.
  */
 
 #include <string.h>
@@ -34,7 +43,18 @@
 #include <time.h>
 #include <trusty_unittest.h>
 #include <lib/hwkey/hwkey.h>
+#include <lib/hwkey_ext/hwkey_async.h>
+#include <lib/hwkey_ext/hwkey_batch.h>
+#include <lib/hwkey_ext/hwkey_cache.h>
+#include <lib/memprof/memprof.h>
+#include <lib/perf/perf_stats.h>
 #include <lib/rng/trusty_rng.h>
+#include <lib/rng_ext/rng_pool.h>
+#include <lib/storage/storage.h>
+#include <lib/testreg/testreg.h>
+
+#include "hwrng_bench.h"
+#include "manifest.h"
 
 #define LOG_TAG "hwcrypto_unittest"
 
@@ -52,6 +72,15 @@ __WEAK void run_device_hwcrypto_unittest(void) { }
 
 static hwkey_session_t hwkey_session_;
 
+/* run test case fn, recording its time and whether it passed */
+#define TIMED_TEST(fn)                                  \
+	do {                                            \
+		uint _failed = _tests_failed;           \
+		testreg_begin("hwcrypto", #fn);         \
+		fn();                                   \
+		testreg_end(_tests_failed == _failed);  \
+	} while (0)
+
 static void generic_invalid_session(void)
 {
 	TEST_BEGIN(__func__);
@@ -158,6 +187,272 @@ static void hwkey_derive_different(void)
 	TEST_END
 }
 
+#define BATCH_KEY_CNT 12
+#define BATCH_TIMEOUT_MS 1000
+
+static void hwkey_derive_batch_same(void)
+{
+	TEST_BEGIN(__func__);
+
+	static const uint32_t size = 32;
+	static uint8_t src_data[BATCH_KEY_CNT][32];
+	static uint8_t dest[BATCH_KEY_CNT][32];
+	uint8_t single[size];
+	struct hwkey_derive_req reqs[BATCH_KEY_CNT];
+	uint32_t kdf_version;
+	long rc;
+
+	/* more keys than fit in flight, last one repeats the first */
+	for (uint i = 0; i < BATCH_KEY_CNT; i++) {
+		memcpy(src_data[i], "thirtytwo-bytes-of-nonsense-data", size);
+		src_data[i][0] = 'a' + (i % (BATCH_KEY_CNT - 1));
+		memset(dest[i], 0, size);
+		reqs[i] = (struct hwkey_derive_req) {
+			.kdf_version = HWKEY_KDF_VERSION_BEST,
+			.src = src_data[i],
+			.dest = dest[i],
+			.size = size,
+		};
+	}
+
+	rc = hwkey_derive_batch(hwkey_session_, reqs, BATCH_KEY_CNT,
+				BATCH_TIMEOUT_MS);
+	EXPECT_EQ (NO_ERROR, rc, "derive batch - batch");
+
+	for (uint i = 0; i < BATCH_KEY_CNT; i++) {
+		EXPECT_EQ (NO_ERROR, reqs[i].rc, "derive batch - request");
+		EXPECT_NE (HWKEY_KDF_VERSION_BEST, reqs[i].kdf_version,
+			   "derive batch - kdf version");
+
+		kdf_version = HWKEY_KDF_VERSION_BEST;
+		rc = hwkey_derive(hwkey_session_, &kdf_version, src_data[i],
+				  single, size);
+		EXPECT_EQ (NO_ERROR, rc, "derive batch - single derivation");
+		EXPECT_EQ (kdf_version, reqs[i].kdf_version,
+			   "derive batch - same kdf version");
+		rc = memcmp(single, dest[i], size);
+		EXPECT_EQ (0, rc, "derive batch - same as single");
+	}
+
+	rc = memcmp(dest[0], dest[1], size);
+	EXPECT_NE (0, rc, "derive batch - different sources equal");
+	rc = memcmp(dest[0], dest[BATCH_KEY_CNT - 1], size);
+	EXPECT_EQ (0, rc, "derive batch - same sources differ");
+
+	TEST_END
+}
+
+static void hwkey_derive_batch_errors(void)
+{
+	TEST_BEGIN(__func__);
+
+	static const uint32_t size = 32;
+	const uint8_t src_data[] = "thirtytwo-bytes-of-nonsense-data";
+	uint8_t dest[2][size];
+	struct hwkey_derive_req reqs[3] = {
+		{ HWKEY_KDF_VERSION_BEST, src_data, dest[0], size, 0 },
+		{ HWKEY_KDF_VERSION_BEST, NULL, NULL, 0, 0 },
+		{ HWKEY_KDF_VERSION_BEST, src_data, dest[1], size, 0 },
+	};
+
+	/* bad entry fails on its own, the rest goes through */
+	long rc = hwkey_derive_batch(hwkey_session_, reqs, countof(reqs),
+				     BATCH_TIMEOUT_MS);
+	EXPECT_EQ (NO_ERROR, rc, "derive batch errors - batch");
+	EXPECT_EQ (NO_ERROR, reqs[0].rc, "derive batch errors - first");
+	EXPECT_EQ (ERR_NOT_VALID, reqs[1].rc, "derive batch errors - zero length");
+	EXPECT_EQ (NO_ERROR, reqs[2].rc, "derive batch errors - last");
+	rc = memcmp(dest[0], dest[1], size);
+	EXPECT_EQ (0, rc, "derive batch errors - equal");
+
+	/* whole batch fails on bad session */
+	reqs[1] = reqs[0];
+	rc = hwkey_derive_batch(INVALID_IPC_HANDLE, reqs, countof(reqs),
+				BATCH_TIMEOUT_MS);
+	EXPECT_EQ (ERR_BAD_HANDLE, rc, "derive batch errors - bad handle");
+	EXPECT_EQ (ERR_BAD_HANDLE, reqs[2].rc, "derive batch errors - bad handle rc");
+
+	TEST_END
+}
+
+static void async_count_done(struct hwkey_async *ha,
+			     struct hwkey_derive_req *req, void *priv)
+{
+	(*(uint *)priv)++;
+}
+
+static void hwkey_derive_async_same(void)
+{
+	TEST_BEGIN(__func__);
+
+	static const uint32_t size = 32;
+	static uint8_t src_data[HWKEY_ASYNC_MAX_INFLIGHT][32];
+	static uint8_t dest[HWKEY_ASYNC_MAX_INFLIGHT][32];
+	uint8_t single[size];
+	struct hwkey_derive_req reqs[HWKEY_ASYNC_MAX_INFLIGHT + 1];
+	struct hwkey_async ha;
+	uint32_t kdf_version;
+	uint done_cnt = 0;
+	uevent_t ev;
+	long rc;
+
+	hwkey_async_init(&ha, hwkey_session_);
+	set_cookie(hwkey_session_, &ha);
+
+	for (uint i = 0; i < HWKEY_ASYNC_MAX_INFLIGHT; i++) {
+		memcpy(src_data[i], "thirtytwo-bytes-of-nonsense-data", size);
+		src_data[i][0] = 'a' + i;
+		memset(dest[i], 0, size);
+		reqs[i] = (struct hwkey_derive_req) {
+			.kdf_version = HWKEY_KDF_VERSION_BEST,
+			.src = src_data[i],
+			.dest = dest[i],
+			.size = size,
+		};
+		rc = hwkey_derive_submit(&ha, &reqs[i], async_count_done,
+					 &done_cnt);
+		EXPECT_GE_ZERO (rc, "derive async - submit");
+	}
+
+	/* all slots taken, bad requests never get one */
+	reqs[HWKEY_ASYNC_MAX_INFLIGHT] = reqs[0];
+	rc = hwkey_derive_submit(&ha, &reqs[HWKEY_ASYNC_MAX_INFLIGHT],
+				 NULL, NULL);
+	EXPECT_EQ (ERR_NOT_ENOUGH_BUFFER, rc, "derive async - slots full");
+	reqs[HWKEY_ASYNC_MAX_INFLIGHT].size = 0;
+	rc = hwkey_derive_submit(&ha, &reqs[HWKEY_ASYNC_MAX_INFLIGHT],
+				 NULL, NULL);
+	EXPECT_EQ (ERR_NOT_VALID, rc, "derive async - zero length");
+
+	/* complete from the app event loop */
+	rc = NO_ERROR;
+	while (hwkey_async_pending(&ha)) {
+		rc = wait_any(&ev, 1000);
+		if (rc < 0)
+			break;
+		if (ev.cookie != &ha)
+			continue;
+		rc = hwkey_async_handle_event(&ha, &ev);
+		if (rc < 0)
+			break;
+	}
+	EXPECT_GE_ZERO (rc, "derive async - event loop");
+	EXPECT_EQ (HWKEY_ASYNC_MAX_INFLIGHT, done_cnt, "derive async - completions");
+
+	for (uint i = 0; i < HWKEY_ASYNC_MAX_INFLIGHT; i++) {
+		EXPECT_EQ (NO_ERROR, reqs[i].rc, "derive async - request");
+
+		kdf_version = HWKEY_KDF_VERSION_BEST;
+		rc = hwkey_derive(hwkey_session_, &kdf_version, src_data[i],
+				  single, size);
+		EXPECT_EQ (NO_ERROR, rc, "derive async - single derivation");
+		EXPECT_EQ (kdf_version, reqs[i].kdf_version,
+			   "derive async - same kdf version");
+		rc = memcmp(single, dest[i], size);
+		EXPECT_EQ (0, rc, "derive async - same as single");
+	}
+
+	hwkey_async_cancel(&ha);
+	set_cookie(hwkey_session_, NULL);
+
+	TEST_END
+}
+
+#define ASYNC_BENCH_ROUNDS     32
+#define ASYNC_BENCH_READ_SIZE  4096
+#define ASYNC_BENCH_FILE       "hwcrypto_unittest_async_derive"
+
+/*
+ * Each round needs a derived key and a block from storage. Blocking
+ * calls do the two one after the other; with the async client the KDF
+ * runs in hwcrypto while we wait on the storage server.
+ */
+static void hwkey_derive_async_overlap(void)
+{
+	TEST_BEGIN(__func__);
+
+	static const uint32_t size = 32;
+	static uint8_t buf[ASYNC_BENCH_READ_SIZE];
+	const uint8_t src_data[] = "thirtytwo-bytes-of-nonsense-data";
+	uint8_t dest[size];
+	uint8_t dest2[size];
+	uint32_t kdf_version;
+	struct hwkey_derive_req req;
+	struct hwkey_async ha;
+	storage_session_t ss;
+	file_handle_t fh;
+	int64_t t0, serial_ns, async_ns;
+	long rc;
+
+	rc = storage_open_session(&ss, STORAGE_CLIENT_TD_PORT);
+	EXPECT_EQ (NO_ERROR, rc, "derive overlap - open storage session");
+	if (rc != NO_ERROR)
+		goto done;
+
+	rc = storage_open_file(ss, &fh, ASYNC_BENCH_FILE,
+			       STORAGE_FILE_OPEN_CREATE |
+			       STORAGE_FILE_OPEN_TRUNCATE,
+			       STORAGE_OP_COMPLETE);
+	EXPECT_EQ (NO_ERROR, rc, "derive overlap - open file");
+	if (rc != NO_ERROR)
+		goto close_session;
+
+	memset(buf, 0x5a, sizeof(buf));
+	rc = storage_write(fh, 0, buf, sizeof(buf), STORAGE_OP_COMPLETE);
+	EXPECT_EQ ((long)sizeof(buf), rc, "derive overlap - write");
+
+	/* derive, then read */
+	t0 = perf_now_ns();
+	for (uint i = 0; i < ASYNC_BENCH_ROUNDS && rc >= 0; i++) {
+		kdf_version = HWKEY_KDF_VERSION_BEST;
+		rc = hwkey_derive(hwkey_session_, &kdf_version, src_data,
+				  dest, size);
+		if (rc == NO_ERROR)
+			rc = storage_read(fh, 0, buf, sizeof(buf));
+	}
+	serial_ns = perf_now_ns() - t0;
+	EXPECT_EQ ((long)sizeof(buf), rc, "derive overlap - serial");
+
+	/* submit derive, read while it runs, then collect it */
+	hwkey_async_init(&ha, hwkey_session_);
+	t0 = perf_now_ns();
+	for (uint i = 0; i < ASYNC_BENCH_ROUNDS && rc >= 0; i++) {
+		req = (struct hwkey_derive_req) {
+			.kdf_version = HWKEY_KDF_VERSION_BEST,
+			.src = src_data,
+			.dest = dest2,
+			.size = size,
+		};
+		long ticket = hwkey_derive_submit(&ha, &req, NULL, NULL);
+		if (ticket < 0) {
+			rc = ticket;
+			break;
+		}
+		rc = storage_read(fh, 0, buf, sizeof(buf));
+		long rc2 = hwkey_async_wait(&ha, ticket, 1000);
+		if (rc2 != NO_ERROR || req.rc != NO_ERROR)
+			rc = rc2 ? rc2 : req.rc;
+	}
+	async_ns = perf_now_ns() - t0;
+	EXPECT_EQ ((long)sizeof(buf), rc, "derive overlap - async");
+	hwkey_async_cancel(&ha);
+
+	rc = memcmp(dest, dest2, size);
+	EXPECT_EQ (0, rc, "derive overlap - same key");
+
+	perf_print_value("hwkey", "derive_read.serial", "per_round",
+			 serial_ns / ASYNC_BENCH_ROUNDS, "ns");
+	perf_print_value("hwkey", "derive_read.async", "per_round",
+			 async_ns / ASYNC_BENCH_ROUNDS, "ns");
+
+	storage_close_file(fh);
+	storage_delete_file(ss, ASYNC_BENCH_FILE, STORAGE_OP_COMPLETE);
+close_session:
+	storage_close_session(ss);
+done:
+	TEST_END
+}
+
 static void hwkey_derive_zero_length(void)
 {
 	TEST_BEGIN(__func__);
@@ -207,6 +502,142 @@ static void hwkey_get_keybox(void)
 	TEST_END
 }
 
+static void hwkey_cache_derive_repeatable(void)
+{
+	TEST_BEGIN(__func__);
+
+	static const uint32_t size = 32;
+	const uint8_t src_data[] = "thirtytwo-bytes-of-nonsense-data";
+	uint8_t dest[size];
+	uint8_t dest2[size];
+	uint32_t kdf_version = HWKEY_KDF_VERSION_BEST;
+	uint32_t kdf_version2 = HWKEY_KDF_VERSION_BEST;
+	struct hwkey_cache_stats st0, st1;
+
+	memset(dest, 0, size);
+	memset(dest2, 0, size);
+
+	/* session not opened with hwkey_cache_open is refused */
+	long rc = hwkey_cache_derive(hwkey_session_, &kdf_version2, src_data,
+				     dest2, size);
+	EXPECT_EQ (ERR_NOT_FOUND, rc, "cache derive - unregistered session");
+
+	rc = hwkey_cache_open();
+	EXPECT_GT_ZERO (rc + 1, "cache derive - open");
+	if (rc < 0)
+		goto done;
+	hwkey_session_t session = (hwkey_session_t) rc;
+
+	/* reference derivation bypassing cache */
+	rc = hwkey_derive(session, &kdf_version, src_data, dest, size);
+	EXPECT_EQ (NO_ERROR, rc, "cache derive - uncached derivation");
+
+	hwkey_cache_get_stats(&st0);
+
+	/* first cached call goes to server, second one must not */
+	kdf_version2 = HWKEY_KDF_VERSION_BEST;
+	rc = hwkey_cache_derive(session, &kdf_version2, src_data, dest2, size);
+	EXPECT_EQ (NO_ERROR, rc, "cache derive - miss");
+	EXPECT_EQ (kdf_version, kdf_version2, "cache derive - miss kdf version");
+	rc = memcmp(dest, dest2, size);
+	EXPECT_EQ (0, rc, "cache derive - miss equal");
+
+	memset(dest2, 0, size);
+	kdf_version2 = HWKEY_KDF_VERSION_BEST;
+	rc = hwkey_cache_derive(session, &kdf_version2, src_data, dest2, size);
+	EXPECT_EQ (NO_ERROR, rc, "cache derive - hit");
+	EXPECT_EQ (kdf_version, kdf_version2, "cache derive - hit kdf version");
+	rc = memcmp(dest, dest2, size);
+	EXPECT_EQ (0, rc, "cache derive - hit equal");
+
+	hwkey_cache_get_stats(&st1);
+	EXPECT_EQ (st0.misses + 1, st1.misses, "cache derive - miss count");
+	EXPECT_EQ (st0.hits + 1, st1.hits, "cache derive - hit count");
+
+	hwkey_cache_close(session);
+done:
+	TEST_END
+}
+
+static void hwkey_cache_closed_session(void)
+{
+	TEST_BEGIN(__func__);
+
+	const uint8_t src_data[] = "thirtytwo-bytes-of-nonsense-data";
+	static const uint32_t size = 32;
+	uint8_t dest[size];
+	uint32_t kdf_version = HWKEY_KDF_VERSION_BEST;
+	struct hwkey_cache_stats st;
+
+	long rc = hwkey_cache_open();
+	EXPECT_GT_ZERO (rc + 1, "cache closed - open");
+
+	hwkey_session_t session = (hwkey_session_t) rc;
+	rc = hwkey_cache_derive(session, &kdf_version, src_data, dest, size);
+	EXPECT_EQ (NO_ERROR, rc, "cache closed - derive");
+
+	hwkey_cache_close(session);
+	hwkey_cache_get_stats(&st);
+	EXPECT_EQ (0, st.entries, "cache closed - entries left");
+	EXPECT_EQ (0, st.bytes, "cache closed - bytes left");
+
+	/* must not be served from cache */
+	kdf_version = HWKEY_KDF_VERSION_BEST;
+	rc = hwkey_cache_derive(session, &kdf_version, src_data, dest, size);
+	EXPECT_EQ (ERR_NOT_FOUND, rc, "cache closed - closed handle");
+
+	TEST_END
+}
+
+static void hwkey_cache_evict(void)
+{
+	TEST_BEGIN(__func__);
+
+	static const uint32_t size = HWKEY_CACHE_MAX_KEY_SIZE;
+	const uint32_t cnt = HWKEY_CACHE_MAX_BYTES / size + 2;
+	uint8_t src_data[size];
+	uint8_t dest[size];
+	uint8_t first[size];
+	uint32_t kdf_version;
+	struct hwkey_cache_stats st0, st1;
+
+	long rc = hwkey_cache_open();
+	EXPECT_GT_ZERO (rc + 1, "cache evict - open");
+	if (rc < 0)
+		goto done;
+	hwkey_session_t session = (hwkey_session_t) rc;
+
+	hwkey_cache_get_stats(&st0);
+
+	/* derive more keys than fit, first one has to be pushed out */
+	for (uint32_t i = 0; i < cnt; i++) {
+		memset(src_data, 'a' + i, size);
+		kdf_version = HWKEY_KDF_VERSION_BEST;
+		rc = hwkey_cache_derive(session, &kdf_version, src_data,
+					i ? dest : first, size);
+		EXPECT_EQ (NO_ERROR, rc, "cache evict - derive");
+	}
+
+	hwkey_cache_get_stats(&st1);
+	EXPECT_GT (st1.evictions, st0.evictions, "cache evict - evictions");
+	EXPECT_GT (HWKEY_CACHE_MAX_BYTES + 1, st1.bytes, "cache evict - bytes");
+
+	/* evicted key is derived again, to same value */
+	memset(src_data, 'a', size);
+	kdf_version = HWKEY_KDF_VERSION_BEST;
+	rc = hwkey_cache_derive(session, &kdf_version, src_data, dest, size);
+	EXPECT_EQ (NO_ERROR, rc, "cache evict - derive again");
+	rc = memcmp(first, dest, size);
+	EXPECT_EQ (0, rc, "cache evict - equal");
+
+	hwkey_cache_get_stats(&st0);
+	EXPECT_EQ (st1.misses + 1, st0.misses, "cache evict - miss count");
+
+	hwkey_cache_close(session);
+done:
+	TEST_END
+}
+
 static void run_hwkey_tests(void)
 {
 	TLOGI("WELCOME TO HWKEY UNITTEST!\n");
@@ -218,14 +649,21 @@ static void run_hwkey_tests(void)
 
 	hwkey_session_ = (hwkey_session_t) rc;
 
-	generic_invalid_session();
-	generic_closed_session();
-
-	hwkey_derive_repeatable();
-	hwkey_derive_different();
-	hwkey_derive_zero_length();
-	hwkey_get_storage_auth();
-	hwkey_get_keybox();
+	TIMED_TEST(generic_invalid_session);
+	TIMED_TEST(generic_closed_session);
+
+	TIMED_TEST(hwkey_derive_repeatable);
+	TIMED_TEST(hwkey_derive_different);
+	TIMED_TEST(hwkey_derive_batch_same);
+	TIMED_TEST(hwkey_derive_batch_errors);
+	TIMED_TEST(hwkey_derive_async_same);
+	TIMED_TEST(hwkey_derive_async_overlap);
+	TIMED_TEST(hwkey_derive_zero_length);
+	TIMED_TEST(hwkey_get_storage_auth);
+	TIMED_TEST(hwkey_get_keybox);
+	TIMED_TEST(hwkey_cache_derive_repeatable);
+	TIMED_TEST(hwkey_cache_closed_session);
+	TIMED_TEST(hwkey_cache_evict);
 
 	hwkey_close(hwkey_session_);
 
@@ -356,20 +794,140 @@ static void run_hwrng_stats_test(void)
 	TEST_END
 }
 
+static void run_hwrng_pool_test(void)
+{
+	int rc;
+	uint8_t a[16];
+	uint8_t b[16];
+	struct rng_pool_stats st0, st1;
+
+	TEST_BEGIN(__func__);
+
+	rng_pool_flush();
+	rng_pool_get_stats(&st0);
+
+	/* two small requests come from one refill and differ */
+	rc = rng_pool_get(a, sizeof(a));
+	EXPECT_EQ (NO_ERROR, rc, "rng pool - first");
+	rc = rng_pool_get(b, sizeof(b));
+	EXPECT_EQ (NO_ERROR, rc, "rng pool - second");
+	rc = memcmp(a, b, sizeof(a));
+	EXPECT_NE (0, rc, "rng pool - same output twice");
+
+	rng_pool_get_stats(&st1);
+	EXPECT_EQ (st0.refills + 1, st1.refills, "rng pool - refills");
+
+	/* request crossing end of pool has to be completed from next block */
+	for (uint i = 0; i < RNG_POOL_SIZE / (sizeof(a) - 1); i++) {
+		rc = rng_pool_get(a, sizeof(a) - 1);
+		if (rc != NO_ERROR)
+			break;
+	}
+	EXPECT_EQ (NO_ERROR, rc, "rng pool - wrap around");
+	rng_pool_get_stats(&st0);
+	EXPECT_EQ (st1.refills + 1, st0.refills, "rng pool - wrap refills");
+
+	/* large requests bypass pool */
+	rc = rng_pool_get(_rng_buf, sizeof(_rng_buf));
+	EXPECT_EQ (NO_ERROR, rc, "rng pool - direct");
+	rng_pool_get_stats(&st1);
+	EXPECT_EQ (st0.direct + 1, st1.direct, "rng pool - direct count");
+	EXPECT_EQ (st0.refills, st1.refills, "rng pool - direct refills");
+
+	TEST_END
+}
+
+#define RNG_BENCH_REQ_CNT  2048
+#define RNG_BENCH_REQ_SIZE 16
+
+static void run_hwrng_pool_bench(void)
+{
+	int rc = NO_ERROR;
+	uint i;
+	uint64_t t0;
+	int64_t direct_ns, pool_ns;
+	uint8_t nonce[RNG_BENCH_REQ_SIZE];
+	struct rng_pool_stats st0, st1;
+	const uint64_t total = RNG_BENCH_REQ_CNT * RNG_BENCH_REQ_SIZE;
+
+	TEST_BEGIN(__func__);
+
+	t0 = perf_ticks();
+	for (i = 0; i < RNG_BENCH_REQ_CNT && rc == NO_ERROR; i++)
+		rc = trusty_rng_hw_rand(nonce, sizeof(nonce));
+	direct_ns = (int64_t)perf_ticks_to_ns(perf_ticks() - t0);
+	EXPECT_EQ (NO_ERROR, rc, "rng bench - direct");
+
+	rng_pool_flush();
+	rng_pool_get_stats(&st0);
+	t0 = perf_ticks();
+	for (i = 0; i < RNG_BENCH_REQ_CNT && rc == NO_ERROR; i++)
+		rc = rng_pool_get(nonce, sizeof(nonce));
+	pool_ns = (int64_t)perf_ticks_to_ns(perf_ticks() - t0);
+	EXPECT_EQ (NO_ERROR, rc, "rng bench - pool");
+
+	/* one refill per RNG_POOL_SIZE bytes, nothing goes direct */
+	rng_pool_get_stats(&st1);
+	EXPECT_EQ (st0.requests + RNG_BENCH_REQ_CNT, st1.requests,
+		   "rng bench - pool requests");
+	EXPECT_EQ (st0.refills + total / RNG_POOL_SIZE, st1.refills,
+		   "rng bench - pool refills");
+	EXPECT_EQ (st0.direct, st1.direct, "rng bench - pool direct");
+
+	perf_print_value("hwrng", "direct.req16", "per_req",
+			 direct_ns / RNG_BENCH_REQ_CNT, "ns");
+	perf_print_value("hwrng", "direct.req16", "bw",
+			 direct_ns > 0 ? total * 1000000000ULL / 1024 / direct_ns : 0,
+			 "KB/s");
+	perf_print_value("hwrng", "pool.req16", "per_req",
+			 pool_ns / RNG_BENCH_REQ_CNT, "ns");
+	perf_print_value("hwrng", "pool.req16", "bw",
+			 pool_ns > 0 ? total * 1000000000ULL / 1024 / pool_ns : 0,
+			 "KB/s");
+
+	TEST_END
+}
+
 static void run_hwrng_tests(void)
 {
 	TLOGI("WELCOME TO HWRNG UNITTEST!\n");
-	run_hwrng_show_data_test();
-	run_hwrng_var_rng_req_test();
-	run_hwrng_stats_test();
+	TIMED_TEST(run_hwrng_show_data_test);
+	TIMED_TEST(run_hwrng_var_rng_req_test);
+	TIMED_TEST(run_hwrng_stats_test);
+	TIMED_TEST(run_hwrng_pool_test);
+	TIMED_TEST(run_hwrng_pool_bench);
 }
 
+#ifdef WITH_HWRNG_BENCHMARK
+static void run_hwrng_quality_bench(void)
+{
+	TEST_BEGIN(__func__);
+	EXPECT_EQ (0, run_hwrng_benchmark(), "hwrng quality");
+	TEST_END
+}
+#endif
+
 static void run_all_tests(void) {
 	run_hwrng_tests();
 	run_hwkey_tests();
+
+#ifdef WITH_HWRNG_BENCHMARK
+	/* MBs of output per request size, takes a while */
+	TIMED_TEST(run_hwrng_quality_bench);
+#endif
 }
 
 int main(void) {
+	MEMPROF_INIT(APP_MIN_STACK_SIZE);
 	run_all_tests();
+	MEMPROF_REPORT("hwcrypto-unittest", APP_MIN_HEAP_SIZE,
+	               APP_MIN_STACK_SIZE);
+
+#ifdef WITH_TESTREG
+	/* waits for the collector to ask */
+	int rc = testreg_publish();
+	if (rc < 0)
+		TLOGI("failed (%d) to publish test records\n", rc);
+#endif
 }
 
@@ -18,6 +18,8 @@
 #include <stddef.h>
 #include <stdio.h>
 
+#include "manifest.h"
+
 trusty_app_manifest_t TRUSTY_APP_MANIFEST_ATTRS trusty_app_manifest =
 {
 	.uuid = HWCRYPTO_UNITTEST_APP_UUID,
@@ -26,10 +28,10 @@ trusty_app_manifest_t TRUSTY_APP_MANIFEST_ATTRS trusty_app_manifest =
 	.config_options =
 	{
 		/* one page for heap */
-		TRUSTY_APP_CONFIG_MIN_HEAP_SIZE(4096),
+		TRUSTY_APP_CONFIG_MIN_HEAP_SIZE(APP_MIN_HEAP_SIZE),
 
 		/* one page for stack */
-		TRUSTY_APP_CONFIG_MIN_STACK_SIZE(4096),
+		TRUSTY_APP_CONFIG_MIN_STACK_SIZE(APP_MIN_STACK_SIZE),
 	},
 };
 
@@ -20,13 +20,20 @@ MODULE := $(LOCAL_DIR)
 MODULE_SRCS += \
 	$(LOCAL_DIR)/manifest.c \
 	$(LOCAL_DIR)/main.c \
+	$(LOCAL_DIR)/hwrng_bench.c \
 
 MODULE_DEPS += \
 	$(HWCRYPTO_UNITTEST_DEVICE_MODULE) \
 	app/trusty \
 	lib/libc-trusty \
 	lib/hwkey \
-	lib/rng
+	app/sample/lib/hwkey_ext \
+	app/sample/lib/memprof \
+	app/sample/lib/perf \
+	lib/rng \
+	lib/storage \
+	app/sample/lib/rng_ext \
+	app/sample/lib/testreg \
 
 include make/module.mk
 
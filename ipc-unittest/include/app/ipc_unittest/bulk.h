@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Bulk transfer protocol of "bulk" srv service.
+ *
+ * A transfer is one BULK_CMD_BEGIN control message announcing xfer_id
+ * and total length, followed by the payload split into messages of up
+ * to BULK_MSG_SIZE bytes that the sender keeps queued back to back. The
+ * service answers once per transfer with BULK_CMD_DONE carrying the
+ * number of bytes and checksum it received, or a negative status.
+ *
+ * This kernel does not support passing handles over channels
+ * (send_msg() with num_handles != 0 fails with ERR_NOT_SUPPORTED), so
+ * there is no way to hand over a shared memory region; instead the
+ * payload moves in full size messages with no per chunk round trip.
+ */
+#define BULK_CMD_BEGIN     1
+#define BULK_CMD_DONE      2
+
+#define BULK_MSG_SIZE      MAX_PORT_BUF_SIZE
+#define BULK_MSG_NUM       16
+#define BULK_MAX_XFER      (1024 * 1024)
+
+struct bulk_ctrl {
+	uint32_t cmd;
+	uint32_t xfer_id;
+	uint32_t len;
+	uint32_t csum;
+	int32_t  status;
+};
+
+/*
+ * Running checksum over transfer payload: cheap enough not to dominate
+ * the measurement, order sensitive, and independent of how the payload
+ * is split as long as every chunk but the last is a multiple of 4 bytes.
+ */
+static inline uint32_t bulk_csum(uint32_t csum, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint32_t w;
+
+	for (; len >= 4; p += 4, len -= 4) {
+		memcpy(&w, p, 4);   /* both ends are little endian */
+		csum = ((csum << 1) | (csum >> 31)) + w;
+	}
+	if (len) {
+		w = 0;
+		memcpy(&w, p, len);
+		csum = ((csum << 1) | (csum >> 31)) + w;
+	}
+	return csum;
+}
@@ -27,3 +27,29 @@
 
 #define MSEC 1000000UL
 #define SRV_PATH_BASE   "com.android.ipc-unittest"
+
+/* queue depth (msg_num) of "echo" srv port */
+#define ECHO_MSG_NUM      8
+
+/*
+ * Number of srv instances: srv itself plus srv-shard1 .. srv-shard3.
+ * Shard N serves every srv port under its name with ".sN" appended.
+ */
+#define SRV_SHARD_CNT     4
+
+#define IPC_UNITTEST_SRV_SHARD_APP_UUID(n) \
+	{ 0x5c1a6f3e, 0x2b7d, 0x4e90, \
+	  { 0x8f, 0x41, 0x6a, 0x0c, 0xd3, 0x95, 0x17, (n) } }
+
+/*
+ * Optional command sent as the first message on ctrl channel.
+ * If there is none, all unittests are run.
+ */
+#define CTRL_CMD_MAX_LEN        16
+#define CTRL_CMD_RUN_TESTS      "test"
+#define CTRL_CMD_RUN_BENCH      "bench"
+#define CTRL_CMD_RUN_STRESS     "stress"
+#define CTRL_CMD_RUN_REGRESS    "regress"   /* tests, collect, compare */
+#define CTRL_CMD_SAVE_BASELINE  "baseline"  /* records of last regress */
+
+int sync_connect(const char *path, uint timeout);
@@ -0,0 +1,613 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <err.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <trusty_std.h>
+
+#define LOG_TAG "ipc-unittest-bench"
+
+#include <app/ipc_unittest/common.h>
+#include <lib/perf/perf_stats.h>
+#include <lib/tipc_fc/tipc_fc.h>
+#include <lib/tipc_pool/tipc_pool.h>
+#include <lib/tipc_rpc/tipc_rpc.h>
+
+#include "bench.h"
+#include "bulk_bench.h"
+
+#define BENCH_WARMUP_CNT    100   /* messages sent before measuring */
+#define BENCH_MSG_CNT      5000   /* messages measured per configuration */
+#define BENCH_REPLY_TIMEOUT 1000  /* ms to wait for reply or room */
+#define BENCH_CONN_CNT     1000   /* requests per connection benchmark */
+#define BENCH_CONN_MSG       64   /* request size for connection benchmark */
+#define BENCH_RPC_MANUAL     -1   /* rpc flags: five calls spelled out */
+
+/* echo ports with different queue depth (msg_num) served by srv */
+static const struct {
+	const char *name;
+	uint depth;
+} _echo_ports[] = {
+	{ "echo.q1",   1 },
+	{ "echo.q2",   2 },
+	{ "echo.q4",   4 },
+	{ "echo",      ECHO_MSG_NUM },
+	{ "echo.q16", 16 },
+};
+
+static const size_t _msg_sizes[] = { 64, 256, 1024, MAX_PORT_BUF_SIZE };
+static const size_t _rpc_sizes[] = { 64, MAX_PORT_BUF_SIZE };
+
+enum bench_mode {
+	BENCH_SYNC,     /* one message at a time */
+	BENCH_PIPE,     /* up to depth in flight, retry refused sends */
+	BENCH_RETRY,    /* send until refused, then wait and retry */
+	BENCH_CREDIT,   /* up to depth in flight, tracked by tipc_fc */
+};
+
+/* client side request/reply variants */
+static const struct {
+	const char *name;
+	int flags;
+} _rpc_modes[] = {
+	{ "manual",    BENCH_RPC_MANUAL },
+	{ "call",      0 },
+	{ "call_poll", TIPC_CALL_POLL_FIRST },
+};
+
+static const char * const _mode_names[] = {
+	[BENCH_SYNC]   = "sync",
+	[BENCH_PIPE]   = "pipe",
+	[BENCH_RETRY]  = "retry",
+	[BENCH_CREDIT] = "credit",
+};
+
+static struct perf_stats _hist;
+static uint8_t _tx_buf[MAX_PORT_BUF_SIZE];
+static uint8_t _rx_buf[MAX_PORT_BUF_SIZE];
+static uint64_t _tx_ts[MAX_PORT_BUF_NUM];   /* perf_ticks() at send */
+static uint64_t _refused;   /* sends that failed with ERR_NOT_ENOUGH_BUFFER */
+
+/****************************************************************************/
+
+/* per message latencies use the cheap counter */
+static int64_t ns_since(uint64_t ticks)
+{
+	return (int64_t)perf_ticks_to_ns(perf_ticks() - ticks);
+}
+
+static void init_msg(ipc_msg_t *msg, iovec_t *iov, void *buf, size_t len)
+{
+	iov->base = buf;
+	iov->len  = len;
+	msg->num_iov = 1;
+	msg->iov     = iov;
+	msg->num_handles = 0;
+	msg->handles = NULL;
+}
+
+/*
+ *  Get, read and retire single echo reply
+ */
+static int bench_read_reply(handle_t chan, size_t msg_size)
+{
+	int rc;
+	iovec_t iov;
+	ipc_msg_t msg;
+	ipc_msg_info_t inf;
+
+	rc = get_msg(chan, &inf);
+	if (rc != NO_ERROR)
+		return rc;
+
+	init_msg(&msg, &iov, _rx_buf, sizeof(_rx_buf));
+	rc = read_msg(chan, inf.id, 0, &msg);
+	put_msg(chan, inf.id);
+	if (rc < 0)
+		return rc;
+
+	return ((size_t)rc == msg_size) ? NO_ERROR : ERR_BAD_LEN;
+}
+
+/*
+ *  Send one message and wait for its reply
+ */
+static int bench_roundtrip(handle_t chan, ipc_msg_t *msg, size_t msg_size)
+{
+	int rc;
+	uevent_t uevt;
+
+	rc = send_msg(chan, msg);
+	if (rc < 0)
+		return rc;
+
+	rc = wait(chan, &uevt, BENCH_REPLY_TIMEOUT);
+	if (rc != NO_ERROR)
+		return rc;
+
+	if (!(uevt.event & IPC_HANDLE_POLL_MSG))
+		return ERR_CHANNEL_CLOSED;
+
+	return bench_read_reply(chan, msg_size);
+}
+
+/*
+ *  Send messages one by one waiting for reply for each one
+ */
+static int bench_echo_sync(handle_t chan, size_t msg_size, uint msg_cnt)
+{
+	int rc;
+	iovec_t iov;
+	ipc_msg_t msg;
+
+	init_msg(&msg, &iov, _tx_buf, msg_size);
+
+	while (msg_cnt--) {
+		uint64_t t0 = perf_ticks();
+
+		rc = bench_roundtrip(chan, &msg, msg_size);
+		if (rc != NO_ERROR)
+			return rc;
+
+		perf_stats_add(&_hist, ns_since(t0));
+	}
+
+	return NO_ERROR;
+}
+
+/*
+ *  Keep up to depth messages in flight. Echo replies come back in order,
+ *  so send timestamps are matched to replies through a simple ring.
+ */
+static int bench_echo_pipelined(handle_t chan, size_t msg_size,
+                                uint depth, uint msg_cnt)
+{
+	int rc;
+	iovec_t iov;
+	ipc_msg_t msg;
+	uevent_t uevt;
+	uint tx_cnt = msg_cnt;
+	uint rx_cnt = msg_cnt;
+	uint ts_r = 0;
+	uint ts_w = 0;
+
+	depth = MIN(depth, countof(_tx_ts));
+	init_msg(&msg, &iov, _tx_buf, msg_size);
+
+	while (rx_cnt) {
+		/* fill the pipe */
+		while (tx_cnt && (rx_cnt - tx_cnt) < depth) {
+			uint64_t t0 = perf_ticks();
+
+			rc = send_msg(chan, &msg);
+			if (rc == ERR_NOT_ENOUGH_BUFFER) {
+				_refused++;
+				break;
+			}
+			if (rc < 0)
+				return rc;
+
+			_tx_ts[ts_w] = t0;
+			ts_w = (ts_w + 1) % countof(_tx_ts);
+			tx_cnt--;
+		}
+
+		/* wait for reply or room */
+		rc = wait(chan, &uevt, BENCH_REPLY_TIMEOUT);
+		if (rc != NO_ERROR)
+			return rc;
+
+		if (uevt.event & (IPC_HANDLE_POLL_HUP | IPC_HANDLE_POLL_ERROR))
+			return ERR_CHANNEL_CLOSED;
+
+		/* drain all replies */
+		while (rx_cnt != tx_cnt) {
+			rc = bench_read_reply(chan, msg_size);
+			if (rc == ERR_NO_MSG)
+				break;
+			if (rc != NO_ERROR)
+				return rc;
+
+			perf_stats_add(&_hist, ns_since(_tx_ts[ts_r]));
+			ts_r = (ts_r + 1) % countof(_tx_ts);
+			rx_cnt--;
+		}
+	}
+
+	return NO_ERROR;
+}
+
+/*
+ *  Same as bench_echo_pipelined, but sends are gated by credits: one per
+ *  echo buffer, returned when the reply is read. Echo retires requests
+ *  before replying, so sends are not expected to be refused.
+ */
+static int bench_echo_credit(handle_t chan, size_t msg_size,
+                             uint depth, uint msg_cnt)
+{
+	long rc;
+	iovec_t iov;
+	ipc_msg_t msg;
+	uevent_t uevt;
+	struct tipc_fc fc;
+	uint tx_cnt = msg_cnt;
+	uint rx_cnt = msg_cnt;
+	uint ts_r = 0;
+	uint ts_w = 0;
+
+	tipc_fc_init(&fc, MIN(depth, countof(_tx_ts)));
+	init_msg(&msg, &iov, _tx_buf, msg_size);
+
+	while (rx_cnt) {
+		/* use all credits */
+		while (tx_cnt && tipc_fc_can_send(&fc)) {
+			uint64_t t0 = perf_ticks();
+
+			rc = tipc_fc_send(&fc, chan, &msg);
+			if (rc == ERR_NOT_ENOUGH_BUFFER)
+				break;
+			if (rc < 0)
+				return (int)rc;
+
+			_tx_ts[ts_w] = t0;
+			ts_w = (ts_w + 1) % countof(_tx_ts);
+			tx_cnt--;
+		}
+
+		/* wait for reply or room */
+		rc = wait(chan, &uevt, BENCH_REPLY_TIMEOUT);
+		if (rc != NO_ERROR)
+			return (int)rc;
+
+		if (uevt.event & (IPC_HANDLE_POLL_HUP | IPC_HANDLE_POLL_ERROR))
+			return ERR_CHANNEL_CLOSED;
+
+		tipc_fc_handle_event(&fc, uevt.event);
+
+		/* drain all replies */
+		while (rx_cnt != tx_cnt) {
+			rc = bench_read_reply(chan, msg_size);
+			if (rc == ERR_NO_MSG)
+				break;
+			if (rc != NO_ERROR)
+				return (int)rc;
+
+			tipc_fc_credit(&fc, 1);
+			perf_stats_add(&_hist, ns_since(_tx_ts[ts_r]));
+			ts_r = (ts_r + 1) % countof(_tx_ts);
+			rx_cnt--;
+		}
+	}
+
+	_refused += fc.stalls;
+	return NO_ERROR;
+}
+
+static int bench_echo(handle_t chan, enum bench_mode mode, size_t msg_size,
+                      uint depth, uint msg_cnt)
+{
+	switch (mode) {
+	case BENCH_SYNC:
+		return bench_echo_sync(chan, msg_size, msg_cnt);
+	case BENCH_PIPE:
+		return bench_echo_pipelined(chan, msg_size, depth, msg_cnt);
+	case BENCH_RETRY:
+		/* only bound is the timestamp ring */
+		return bench_echo_pipelined(chan, msg_size, countof(_tx_ts),
+		                            msg_cnt);
+	case BENCH_CREDIT:
+		return bench_echo_credit(chan, msg_size, depth, msg_cnt);
+	}
+	return ERR_INVALID_ARGS;
+}
+
+/*
+ *  Print results of last run, returns its rate in msgs/s
+ */
+static int64_t bench_report(const char *mode, const char *port,
+                            size_t msg_size, uint depth, int64_t elapsed)
+{
+	uint64_t ns = elapsed > 0 ? (uint64_t)elapsed : 1;
+	int64_t msgs_ps = (int64_t)(_hist.cnt * 1000000000ULL / ns);
+	char name[64];
+
+	snprintf(name, sizeof(name), "%s.%s.size%zu.depth%u",
+	         mode, port, msg_size, depth);
+	perf_print_stats("ipc", name, &_hist, "ns");
+	perf_print_value("ipc", name, "msgs", msgs_ps, "msgs/s");
+	perf_print_value("ipc", name, "bw",
+	                 _hist.cnt * msg_size * 1000000000ULL / 1024 / ns,
+	                 "KB/s");
+	perf_print_value("ipc", name, "refused", _refused, "sends");
+	return msgs_ps;
+}
+
+/*
+ *  Run single benchmark configuration against specified echo port,
+ *  returns msgs/s or negative error
+ */
+static int64_t run_echo_bench(const char *name, uint depth,
+                              size_t msg_size, enum bench_mode mode)
+{
+	int rc;
+	handle_t chan;
+	int64_t t0;
+	int64_t msgs_ps = 0;
+	char path[MAX_PORT_PATH_LEN];
+
+	sprintf(path, "%s.srv.%s", SRV_PATH_BASE, name);
+	rc = sync_connect(path, 1000);
+	if (rc < 0) {
+		TLOGI("failed (%d) to connect to %s\n", rc, name);
+		return rc;
+	}
+	chan = (handle_t) rc;
+
+	memset(_tx_buf, 0x55, msg_size);
+
+	/* warm up caches and allocator on both sides */
+	perf_stats_reset(&_hist);
+	rc = bench_echo(chan, mode, msg_size, depth, BENCH_WARMUP_CNT);
+	if (rc != NO_ERROR)
+		goto err_bench;
+
+	perf_stats_reset(&_hist);
+	_refused = 0;
+	t0 = perf_now_ns();
+	rc = bench_echo(chan, mode, msg_size, depth, BENCH_MSG_CNT);
+	if (rc != NO_ERROR)
+		goto err_bench;
+
+	msgs_ps = bench_report(_mode_names[mode], name, msg_size, depth,
+	                       perf_now_ns() - t0);
+
+err_bench:
+	if (rc != NO_ERROR) {
+		TLOGI("%s benchmark on %s (size %zu) failed (%d)\n",
+		      _mode_names[mode], name, msg_size, rc);
+	}
+	close(chan);
+	return rc != NO_ERROR ? rc : msgs_ps;
+}
+
+/*
+ *  One echo request per connection: either a fresh connect/close around
+ *  every request or a channel taken from and returned to a pool.
+ *  Returns requests/s or negative error.
+ */
+static int64_t run_conn_bench(bool pooled)
+{
+	int rc = NO_ERROR;
+	iovec_t iov;
+	ipc_msg_t msg;
+	int64_t t0, elapsed;
+	struct tipc_pool pool;
+	char path[MAX_PORT_PATH_LEN];
+	char name[32];
+	const char *mode = pooled ? "pooled" : "connect";
+
+	sprintf(path, "%s.srv.%s", SRV_PATH_BASE, "echo");
+	rc = tipc_pool_init(&pool, path, BENCH_REPLY_TIMEOUT);
+	if (rc != NO_ERROR)
+		return rc;
+
+	init_msg(&msg, &iov, _tx_buf, BENCH_CONN_MSG);
+	memset(_tx_buf, 0x55, BENCH_CONN_MSG);
+	perf_stats_reset(&_hist);
+
+	t0 = perf_now_ns();
+	for (uint i = 0; i < BENCH_CONN_CNT; i++) {
+		int64_t t1 = perf_now_ns();
+		handle_t chan;
+
+		rc = pooled ? tipc_pool_get(&pool) :
+		              sync_connect(path, BENCH_REPLY_TIMEOUT);
+		if (rc < 0)
+			break;
+		chan = (handle_t) rc;
+
+		rc = bench_roundtrip(chan, &msg, BENCH_CONN_MSG);
+		if (pooled)
+			tipc_pool_put(&pool, chan, rc);
+		else
+			close(chan);
+		if (rc != NO_ERROR)
+			break;
+
+		perf_stats_add(&_hist, perf_now_ns() - t1);
+	}
+	elapsed = perf_now_ns() - t0;
+	tipc_pool_drain(&pool);
+
+	if (rc < 0) {
+		TLOGI("%s benchmark failed (%d)\n", mode, rc);
+		return rc;
+	}
+
+	uint64_t ns = elapsed > 0 ? (uint64_t)elapsed : 1;
+	int64_t req_ps = (int64_t)(_hist.cnt * 1000000000ULL / ns);
+
+	snprintf(name, sizeof(name), "conn.%s.size%u", mode, BENCH_CONN_MSG);
+	perf_print_stats("ipc", name, &_hist, "ns");
+	perf_print_value("ipc", name, "reqs", req_ps, "reqs/s");
+	if (pooled) {
+		perf_print_value("ipc", name, "connects",
+		                 pool.stats.connects, "chans");
+		perf_print_value("ipc", name, "stale", pool.stats.stale,
+		                 "chans");
+	}
+	return req_ps;
+}
+
+/*
+ *  Echo round trips of one rpc variant, returns median latency in ns
+ */
+static int64_t run_rpc_bench(const char *mode, int flags, size_t msg_size)
+{
+	int rc;
+	handle_t chan;
+	iovec_t tx_iov, rx_iov;
+	ipc_msg_t tx_msg, rx_msg;
+	struct tipc_call_stats st0, st1;
+	char path[MAX_PORT_PATH_LEN];
+	char name[48];
+
+	sprintf(path, "%s.srv.%s", SRV_PATH_BASE, "echo");
+	rc = sync_connect(path, BENCH_REPLY_TIMEOUT);
+	if (rc < 0) {
+		TLOGI("failed (%d) to connect to echo\n", rc);
+		return rc;
+	}
+	chan = (handle_t) rc;
+
+	init_msg(&tx_msg, &tx_iov, _tx_buf, msg_size);
+	init_msg(&rx_msg, &rx_iov, _rx_buf, sizeof(_rx_buf));
+	memset(_tx_buf, 0x55, msg_size);
+	perf_stats_reset(&_hist);
+	tipc_call_get_stats(&st0);
+
+	for (uint i = 0; i < BENCH_WARMUP_CNT + BENCH_MSG_CNT; i++) {
+		uint64_t t0 = perf_ticks();
+
+		if (flags == BENCH_RPC_MANUAL) {
+			rc = bench_roundtrip(chan, &tx_msg, msg_size);
+		} else {
+			rc = tipc_call(chan, &tx_msg, &rx_msg,
+			               BENCH_REPLY_TIMEOUT, (uint32_t)flags);
+			if (rc >= 0)
+				rc = ((size_t)rc == msg_size) ? NO_ERROR
+				                              : ERR_BAD_LEN;
+		}
+		if (rc != NO_ERROR)
+			break;
+
+		if (i >= BENCH_WARMUP_CNT)
+			perf_stats_add(&_hist, ns_since(t0));
+	}
+	close(chan);
+
+	if (rc != NO_ERROR) {
+		TLOGI("rpc %s benchmark (size %zu) failed (%d)\n",
+		      mode, msg_size, rc);
+		return rc;
+	}
+
+	snprintf(name, sizeof(name), "rpc.%s.size%zu", mode, msg_size);
+	perf_print_stats("ipc", name, &_hist, "ns");
+	if (flags != BENCH_RPC_MANUAL) {
+		tipc_call_get_stats(&st1);
+		uint64_t calls = st1.calls - st0.calls;
+		perf_print_value("ipc", name, "polled",
+		                 calls ? (st1.polled - st0.polled) * 1000 / calls
+		                       : 0, "permille");
+	}
+	return (int64_t)perf_stats_pct(&_hist, 500);
+}
+
+/*
+ *  Sweep message size, queue depth and send mode over echo service
+ */
+void run_all_benchmarks(void)
+{
+	uint failed = 0;
+
+	TLOGI("Run all benchmarks\n");
+
+	/* sync round trips: queue depth does not matter */
+	for (uint i = 0; i < countof(_msg_sizes); i++) {
+		if (run_echo_bench("echo", 1, _msg_sizes[i], BENCH_SYNC) < 0)
+			failed++;
+	}
+
+	/* pipelined sends */
+	for (uint j = 0; j < countof(_echo_ports); j++) {
+		for (uint i = 0; i < countof(_msg_sizes); i++) {
+			if (run_echo_bench(_echo_ports[j].name,
+			                   _echo_ports[j].depth,
+			                   _msg_sizes[i], BENCH_PIPE) < 0)
+				failed++;
+		}
+	}
+
+	/* sustained throughput: retry on refusal vs credits */
+	for (uint j = 0; j < countof(_echo_ports); j++) {
+		const char *port = _echo_ports[j].name;
+		uint depth = _echo_ports[j].depth;
+		char name[64];
+
+		for (uint i = 0; i < countof(_msg_sizes); i++) {
+			size_t size = _msg_sizes[i];
+			int64_t retry = run_echo_bench(port, depth, size,
+			                               BENCH_RETRY);
+			int64_t credit = run_echo_bench(port, depth, size,
+			                                BENCH_CREDIT);
+
+			if (retry < 0 || credit < 0) {
+				failed++;
+				continue;
+			}
+
+			snprintf(name, sizeof(name),
+			         "credit_vs_retry.%s.size%zu", port, size);
+			perf_print_value("ipc", name, "speedup",
+			                 retry ? credit * 1000 / retry : 0,
+			                 "permille");
+		}
+	}
+
+	/* rpc: five calls spelled out vs tipc_call() */
+	for (uint i = 0; i < countof(_rpc_sizes); i++) {
+		size_t size = _rpc_sizes[i];
+		int64_t p50[countof(_rpc_modes)];
+		char name[48];
+
+		for (uint j = 0; j < countof(_rpc_modes); j++) {
+			p50[j] = run_rpc_bench(_rpc_modes[j].name,
+			                       _rpc_modes[j].flags, size);
+			if (p50[j] < 0)
+				failed++;
+		}
+		for (uint j = 1; j < countof(_rpc_modes); j++) {
+			if (p50[0] <= 0 || p50[j] <= 0)
+				continue;
+			snprintf(name, sizeof(name), "rpc.%s_vs_manual.size%zu",
+			         _rpc_modes[j].name, size);
+			perf_print_value("ipc", name, "p50_speedup",
+			                 p50[0] * 1000 / p50[j], "permille");
+		}
+	}
+
+	/* connection setup: connect+send+close vs pooled channel */
+	int64_t fresh = run_conn_bench(false);
+	int64_t pooled = run_conn_bench(true);
+	if (fresh < 0 || pooled < 0) {
+		failed++;
+	} else {
+		perf_print_value("ipc", "conn.pooled_vs_connect", "speedup",
+		                 fresh ? pooled * 1000 / fresh : 0, "permille");
+	}
+
+	if (failed)
+		TLOGI("%u benchmark(s) FAILED\n", failed);
+	else
+		TLOGI("All benchmarks completed\n");
+
+	/* large transfers: bulk service vs chunked echo */
+	run_bulk_benchmarks();
+}
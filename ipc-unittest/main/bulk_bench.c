@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <err.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <trusty_std.h>
+
+#define LOG_TAG "ipc-unittest-bulk"
+
+#include <app/ipc_unittest/common.h>
+#include <app/ipc_unittest/bulk.h>
+#include <lib/perf/perf_stats.h>
+#include <lib/tipc_fc/tipc_fc.h>
+
+#include "bulk_bench.h"
+
+#define BULK_BENCH_MAX      (128 * 1024)
+#define BULK_BENCH_REPS     16      /* transfers per configuration */
+#define BULK_BENCH_TIMEOUT  1000    /* ms to wait for room or reply */
+#define ECHO_PIPE_PORT      "echo.q16"
+#define ECHO_PIPE_DEPTH     16      /* msg_num of ECHO_PIPE_PORT */
+
+static const size_t _xfer_sizes[] = {
+	16 * 1024, 64 * 1024, BULK_BENCH_MAX,
+};
+
+static uint8_t _payload[BULK_BENCH_MAX];
+static uint8_t _reply_buf[MAX_PORT_BUF_SIZE];
+static struct perf_stats _xfer_stats;
+static uint32_t _xfer_id;
+
+/****************************************************************************/
+
+/*
+ *  Send message, waiting for room in peer queue if needed
+ */
+static int bulk_send(handle_t chan, const void *buf, size_t len)
+{
+	int rc;
+	uevent_t uevt;
+	iovec_t iov = { .base = (void *)buf, .len = len };
+	ipc_msg_t msg = {
+		.num_iov = 1, .iov = &iov, .num_handles = 0, .handles = NULL,
+	};
+
+	for (;;) {
+		rc = send_msg(chan, &msg);
+		if (rc != ERR_NOT_ENOUGH_BUFFER)
+			break;
+
+		rc = wait(chan, &uevt, BULK_BENCH_TIMEOUT);
+		if (rc != NO_ERROR)
+			return rc;
+		if (uevt.event & (IPC_HANDLE_POLL_HUP | IPC_HANDLE_POLL_ERROR))
+			return ERR_CHANNEL_CLOSED;
+	}
+
+	if (rc < 0)
+		return rc;
+	return ((size_t)rc == len) ? NO_ERROR : ERR_BAD_LEN;
+}
+
+/*
+ *  Read pending message into buf
+ */
+static int bulk_read(handle_t chan, void *buf, size_t len)
+{
+	int rc;
+	ipc_msg_info_t inf;
+	iovec_t iov = { .base = buf, .len = len };
+	ipc_msg_t msg = {
+		.num_iov = 1, .iov = &iov, .num_handles = 0, .handles = NULL,
+	};
+
+	rc = get_msg(chan, &inf);
+	if (rc != NO_ERROR)
+		return rc;
+
+	rc = read_msg(chan, inf.id, 0, &msg);
+	put_msg(chan, inf.id);
+	return rc;
+}
+
+/*
+ *  Wait for next message and read it into buf
+ */
+static int bulk_recv(handle_t chan, void *buf, size_t len)
+{
+	int rc;
+	uevent_t uevt;
+
+	do {
+		rc = wait(chan, &uevt, BULK_BENCH_TIMEOUT);
+		if (rc != NO_ERROR)
+			return rc;
+		if (uevt.event & (IPC_HANDLE_POLL_HUP | IPC_HANDLE_POLL_ERROR))
+			return ERR_CHANNEL_CLOSED;
+		/* a late SEND_UNBLOCKED can show up first */
+	} while (!(uevt.event & IPC_HANDLE_POLL_MSG));
+
+	return bulk_read(chan, buf, len);
+}
+
+/*
+ *  One bulk transfer: BEGIN, payload straight from caller's buffer in
+ *  BULK_MSG_SIZE pieces, then wait for DONE and check what arrived
+ */
+static int bulk_push(handle_t chan, const uint8_t *buf, size_t len)
+{
+	int rc;
+	struct bulk_ctrl ctrl = {
+		.cmd = BULK_CMD_BEGIN,
+		.xfer_id = ++_xfer_id,
+		.len = (uint32_t)len,
+	};
+
+	rc = bulk_send(chan, &ctrl, sizeof(ctrl));
+	if (rc != NO_ERROR)
+		return rc;
+
+	for (size_t off = 0; off < len; off += BULK_MSG_SIZE) {
+		rc = bulk_send(chan, buf + off, MIN(len - off, BULK_MSG_SIZE));
+		if (rc != NO_ERROR)
+			return rc;
+	}
+
+	rc = bulk_recv(chan, &ctrl, sizeof(ctrl));
+	if (rc < 0)
+		return rc;
+	if (rc != sizeof(ctrl) || ctrl.cmd != BULK_CMD_DONE ||
+	    ctrl.xfer_id != _xfer_id)
+		return ERR_BAD_STATE;
+	if (ctrl.status != NO_ERROR)
+		return ctrl.status;
+	if (ctrl.len != len || ctrl.csum != bulk_csum(0, buf, len))
+		return ERR_CHECKSUM_FAIL;
+
+	return NO_ERROR;
+}
+
+/*
+ *  Baseline: same payload as 4 KB messages, each one echoed back before
+ *  the next one goes out
+ */
+static int echo_push(handle_t chan, const uint8_t *buf, size_t len)
+{
+	int rc;
+
+	for (size_t off = 0; off < len; off += MAX_PORT_BUF_SIZE) {
+		size_t n = MIN(len - off, MAX_PORT_BUF_SIZE);
+
+		rc = bulk_send(chan, buf + off, n);
+		if (rc != NO_ERROR)
+			return rc;
+
+		rc = bulk_recv(chan, _reply_buf, sizeof(_reply_buf));
+		if (rc < 0)
+			return rc;
+		if ((size_t)rc != n)
+			return ERR_BAD_LEN;
+	}
+	return NO_ERROR;
+}
+
+/*
+ *  Same 4 KB messages, but up to ECHO_PIPE_DEPTH of them in flight with
+ *  credits tracked by tipc_fc. Unlike the bulk transfer every byte is
+ *  sent back, where bulk gets a single DONE reply
+ */
+static int echo_pipe_push(handle_t chan, const uint8_t *buf, size_t len)
+{
+	int rc;
+	uevent_t uevt;
+	struct tipc_fc fc;
+	size_t tx_off = 0;
+	size_t rx_off = 0;
+
+	tipc_fc_init(&fc, ECHO_PIPE_DEPTH);
+
+	while (rx_off < len) {
+		while (tx_off < len && tipc_fc_can_send(&fc)) {
+			size_t n = MIN(len - tx_off, MAX_PORT_BUF_SIZE);
+			iovec_t iov = { .base = (void *)(buf + tx_off), .len = n };
+			ipc_msg_t msg = {
+				.num_iov = 1, .iov = &iov,
+				.num_handles = 0, .handles = NULL,
+			};
+			long sent = tipc_fc_send(&fc, chan, &msg);
+
+			if (sent == ERR_NOT_ENOUGH_BUFFER)
+				break;
+			if (sent < 0)
+				return (int)sent;
+			if ((size_t)sent != n)
+				return ERR_BAD_LEN;
+			tx_off += n;
+		}
+
+		rc = wait(chan, &uevt, BULK_BENCH_TIMEOUT);
+		if (rc != NO_ERROR)
+			return rc;
+		if (uevt.event & (IPC_HANDLE_POLL_HUP | IPC_HANDLE_POLL_ERROR))
+			return ERR_CHANNEL_CLOSED;
+
+		tipc_fc_handle_event(&fc, uevt.event);
+		if (!(uevt.event & IPC_HANDLE_POLL_MSG))
+			continue;
+
+		rc = bulk_read(chan, _reply_buf, sizeof(_reply_buf));
+		if (rc < 0)
+			return rc;
+		if ((size_t)rc != MIN(len - rx_off, MAX_PORT_BUF_SIZE))
+			return ERR_BAD_LEN;
+		tipc_fc_credit(&fc, 1);
+		rx_off += rc;
+	}
+	return NO_ERROR;
+}
+
+/*
+ *  Run BULK_BENCH_REPS transfers of len bytes, returns KB/s or error
+ */
+static int64_t run_xfer(const char *port, const char *mode, size_t len,
+                        int (*push)(handle_t, const uint8_t *, size_t))
+{
+	int rc;
+	handle_t chan;
+	int64_t t0, elapsed;
+	char path[MAX_PORT_PATH_LEN];
+	char name[48];
+
+	sprintf(path, "%s.srv.%s", SRV_PATH_BASE, port);
+	rc = sync_connect(path, BULK_BENCH_TIMEOUT);
+	if (rc < 0) {
+		TLOGI("failed (%d) to connect to %s\n", rc, port);
+		return rc;
+	}
+	chan = (handle_t) rc;
+
+	perf_stats_reset(&_xfer_stats);
+	t0 = perf_now_ns();
+	for (uint i = 0; i < BULK_BENCH_REPS; i++) {
+		int64_t t1 = perf_now_ns();
+
+		rc = push(chan, _payload, len);
+		if (rc != NO_ERROR) {
+			TLOGI("%s transfer of %zu bytes failed (%d)\n",
+			      mode, len, rc);
+			close(chan);
+			return rc;
+		}
+		perf_stats_add(&_xfer_stats, perf_now_ns() - t1);
+	}
+	elapsed = perf_now_ns() - t0;
+	close(chan);
+
+	int64_t kb_ps = elapsed > 0 ?
+	        (int64_t)(len * BULK_BENCH_REPS * 1000000000ULL / 1024 /
+	                  (uint64_t)elapsed) : 0;
+
+	snprintf(name, sizeof(name), "%s.size%zu", mode, len);
+	perf_print_stats("ipc", name, &_xfer_stats, "ns");
+	perf_print_value("ipc", name, "bw", kb_ps, "KB/s");
+
+	return kb_ps;
+}
+
+void run_bulk_benchmarks(void)
+{
+	uint failed = 0;
+	char name[48];
+
+	TLOGI("Run bulk transfer benchmarks\n");
+
+	for (size_t i = 0; i < sizeof(_payload); i++)
+		_payload[i] = (uint8_t)(i * 7 + (i >> 8));
+
+	for (uint i = 0; i < countof(_xfer_sizes); i++) {
+		size_t len = _xfer_sizes[i];
+		int64_t bulk = run_xfer("bulk", "bulk", len, bulk_push);
+		int64_t chunked = run_xfer("echo", "echo4k", len, echo_push);
+		int64_t piped = run_xfer(ECHO_PIPE_PORT, "echo4k.q16", len,
+		                         echo_pipe_push);
+
+		if (bulk < 0 || chunked < 0 || piped < 0) {
+			failed++;
+			continue;
+		}
+
+		/* same message size and depth: one-way stream vs echo */
+		snprintf(name, sizeof(name), "oneway_vs_echo4k_q16.size%zu", len);
+		perf_print_value("ipc", name, "speedup",
+		                 piped ? bulk * 1000 / piped : 0, "permille");
+	}
+
+	if (failed)
+		TLOGI("%u bulk benchmark(s) FAILED\n", failed);
+	else
+		TLOGI("All bulk benchmarks completed\n");
+}
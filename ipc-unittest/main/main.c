@@ -24,9 +24,21 @@
 #define LOG_TAG "ipc-unittest-main"
 
 #include <app/ipc_unittest/common.h>
+#include <lib/tipc_fc/tipc_fc.h>
+#include <lib/tipc_pool/tipc_pool.h>
+#include <lib/tipc_rpc/tipc_rpc.h>
 
 #include <trace.h>
 
+#include <lib/memprof/memprof.h>
+#include <lib/testreg/testreg.h>
+
+#include "bench.h"
+#include "manifest.h"
+#include "stress.h"
+
+#define CTRL_CMD_TIMEOUT  100  /* ms to wait for optional ctrl command */
+
 /*  */
 static uint _tests_total  = 0; /* Number of conditions checked */
 static uint _tests_failed = 0; /* Number of conditions failed  */
@@ -39,11 +51,13 @@ static const uuid_t srv_app_uuid = IPC_UNITTEST_SRV_APP_UUID;
 #define TEST_BEGIN(name)                                        \
 	bool _all_ok = true;                                    \
 	const char *_test = name;                               \
-	TLOGI("%s:\n", _test);
+	TLOGI("%s:\n", _test);                                  \
+	testreg_begin("ipc", _test);
 
 
 #define TEST_END                                                \
 {                                                               \
+	testreg_end(_all_ok);                                   \
 	if (_all_ok)                                            \
 		TLOGI("%s: PASSED\n", _test);                   \
 	else                                                    \
@@ -1444,6 +1458,312 @@ abort_test:
 	TEST_END
 }
 
+/*
+ *  Same async echo loop, but sends are gated by tipc_fc credits: one per
+ *  echo buffer, returned when the reply is read, so the kernel should
+ *  never refuse a send
+ */
+static void run_end_to_end_fc_msg_test(void)
+{
+	int rc;
+	handle_t chan;
+	uevent_t uevt;
+	char path[MAX_PORT_PATH_LEN];
+	uint8_t tx_buf[64];
+	uint8_t rx_buf[64];
+	ipc_msg_info_t inf;
+	ipc_msg_t   tx_msg;
+	iovec_t     tx_iov;
+	ipc_msg_t   rx_msg;
+	iovec_t     rx_iov;
+	struct tipc_fc fc;
+
+	TEST_BEGIN(__func__);
+
+	tx_iov.base = tx_buf;
+	tx_iov.len  = sizeof(tx_buf);
+	tx_msg.num_iov = 1;
+	tx_msg.iov     = &tx_iov;
+	tx_msg.num_handles = 0;
+	tx_msg.handles = NULL;
+
+	rx_iov.base = rx_buf;
+	rx_iov.len  = sizeof(rx_buf);
+	rx_msg.num_iov = 1;
+	rx_msg.iov     = &rx_iov;
+	rx_msg.num_handles = 0;
+	rx_msg.handles = NULL;
+
+	memset (tx_buf, 0x55, sizeof(tx_buf));
+	memset (rx_buf, 0xaa, sizeof(rx_buf));
+
+	sprintf(path, "%s.srv.%s", SRV_PATH_BASE,  "echo");
+	rc = sync_connect(path, 1000);
+	EXPECT_GE_ZERO (rc, "connect to echo");
+
+	if (rc >= 0) {
+		uint tx_cnt = 10000;
+		uint rx_cnt = 10000;
+
+		chan = (handle_t) rc;
+
+		tipc_fc_init(&fc, ECHO_MSG_NUM);
+		while (tx_cnt || rx_cnt) {
+
+			/* send messages while there are credits */
+			while (tx_cnt && tipc_fc_can_send(&fc)) {
+				rc = tipc_fc_send(&fc, chan, &tx_msg);
+				if (rc == ERR_NOT_ENOUGH_BUFFER)
+					break;  /* wait for SEND_UNBLOCKED */
+				EXPECT_EQ(64, rc, "sending msg to echo");
+				if (rc != 64)
+					goto abort_test;
+				tx_cnt--;
+			}
+
+			/* wait for reply msg or room */
+			rc = wait(chan, &uevt, 1000);
+			EXPECT_EQ (NO_ERROR, rc, "waiting for reply");
+			EXPECT_EQ (chan, uevt.handle, "wait on channel");
+			tipc_fc_handle_event(&fc, uevt.event);
+
+			/* drain all messages */
+			while (rx_cnt) {
+				/* get a reply */
+				rc = get_msg(chan, &inf);
+				if (rc == ERR_NO_MSG)
+					break;  /* no more messages  */
+
+				EXPECT_EQ (NO_ERROR, rc, "getting echo msg");
+
+				/* read reply data */
+				rc = read_msg(chan, inf.id, 0, &rx_msg);
+				EXPECT_EQ (64, rc, "reading echo msg");
+
+				/* discard reply */
+				rc = put_msg(chan, inf.id);
+				EXPECT_EQ (NO_ERROR, rc, "putting echo msg");
+
+				tipc_fc_credit(&fc, 1);
+				rx_cnt--;
+			}
+
+			if (!_all_ok)
+				break;
+		}
+
+abort_test:
+		EXPECT_EQ (0, tx_cnt, "tx_cnt");
+		EXPECT_EQ (0, rx_cnt, "rx_cnt");
+		EXPECT_EQ (0, fc.stalls, "refused sends");
+		EXPECT_EQ (10000, fc.sent, "sent msgs");
+
+		rc = close(chan);
+		EXPECT_EQ (NO_ERROR, rc, "close channel");
+	}
+
+	TEST_END
+}
+
+
+/*
+ *  Send 64 byte message to echo and check it comes back
+ */
+static int echo_roundtrip(handle_t chan)
+{
+	int rc;
+	uevent_t uevt;
+	uint8_t buf[64];
+	ipc_msg_info_t inf;
+	iovec_t iov = { .base = buf, .len = sizeof(buf) };
+	ipc_msg_t msg = {
+		.num_iov = 1, .iov = &iov, .num_handles = 0, .handles = NULL,
+	};
+
+	memset(buf, 0x55, sizeof(buf));
+	rc = send_msg(chan, &msg);
+	if (rc < 0)
+		return rc;
+
+	rc = wait(chan, &uevt, 1000);
+	if (rc != NO_ERROR)
+		return rc;
+	if (!(uevt.event & IPC_HANDLE_POLL_MSG))
+		return ERR_CHANNEL_CLOSED;
+
+	rc = get_msg(chan, &inf);
+	if (rc != NO_ERROR)
+		return rc;
+
+	rc = read_msg(chan, inf.id, 0, &msg);
+	put_msg(chan, inf.id);
+	return rc == (int)sizeof(buf) ? NO_ERROR : ERR_BAD_LEN;
+}
+
+/*
+ *  Connection pool: channel reuse, dropping broken channels and
+ *  replacing idle channels that went stale (unread reply, closed by peer)
+ */
+static void run_conn_pool_test(void)
+{
+	int rc;
+	handle_t chan;
+	struct tipc_pool pool;
+	char path[MAX_PORT_PATH_LEN];
+
+	TEST_BEGIN(__func__);
+
+	sprintf(path, "%s.srv.%s", SRV_PATH_BASE, "echo");
+	rc = tipc_pool_init(&pool, path, 1000);
+	EXPECT_EQ (NO_ERROR, rc, "init pool");
+
+	/* first get connects */
+	rc = tipc_pool_get(&pool);
+	EXPECT_GE_ZERO (rc, "get chan");
+	if (rc >= 0) {
+		chan = (handle_t) rc;
+		rc = echo_roundtrip(chan);
+		EXPECT_EQ (NO_ERROR, rc, "echo on new chan");
+		tipc_pool_put(&pool, chan, rc);
+
+		/* second get reuses it */
+		rc = tipc_pool_get(&pool);
+		EXPECT_EQ (chan, rc, "get idle chan");
+		if (rc >= 0) {
+			chan = (handle_t) rc;
+			rc = echo_roundtrip(chan);
+			EXPECT_EQ (NO_ERROR, rc, "echo on pooled chan");
+
+			/* put with error closes it */
+			tipc_pool_put(&pool, chan, ERR_CHANNEL_CLOSED);
+		}
+		EXPECT_EQ (0, pool.idle_cnt, "idle chans");
+		EXPECT_EQ (1, pool.stats.connects, "connects");
+		EXPECT_EQ (1, pool.stats.hits, "hits");
+		EXPECT_EQ (1, pool.stats.dropped, "dropped");
+	}
+	tipc_pool_drain(&pool);
+
+	/* unread reply makes idle chan stale, next get has to reconnect */
+	rc = tipc_pool_init(&pool, path, 1000);
+	EXPECT_EQ (NO_ERROR, rc, "init pool");
+
+	rc = tipc_pool_get(&pool);
+	EXPECT_GE_ZERO (rc, "get chan");
+	if (rc >= 0) {
+		uevent_t uevt;
+		uint8_t buf[64];
+		iovec_t iov = { .base = buf, .len = sizeof(buf) };
+		ipc_msg_t msg = {
+			.num_iov = 1, .iov = &iov,
+			.num_handles = 0, .handles = NULL,
+		};
+
+		chan = (handle_t) rc;
+		memset(buf, 0x55, sizeof(buf));
+		rc = send_msg(chan, &msg);
+		EXPECT_EQ ((int)sizeof(buf), rc, "send unread request");
+		rc = wait(chan, &uevt, 1000);
+		EXPECT_EQ (NO_ERROR, rc, "wait for unread reply");
+		tipc_pool_put(&pool, chan, NO_ERROR);
+
+		rc = tipc_pool_get(&pool);
+		EXPECT_GE_ZERO (rc, "reconnect");
+		EXPECT_EQ (1, pool.stats.stale, "stale chans");
+		EXPECT_EQ (2, pool.stats.connects, "reconnect connects");
+		if (rc >= 0) {
+			chan = (handle_t) rc;
+			rc = echo_roundtrip(chan);
+			EXPECT_EQ (NO_ERROR, rc, "echo on new chan");
+			tipc_pool_put(&pool, chan, rc);
+		}
+	}
+	tipc_pool_drain(&pool);
+
+	/* closer1 closes every channel it accepts */
+	sprintf(path, "%s.srv.%s", SRV_PATH_BASE, "closer1");
+	rc = tipc_pool_init(&pool, path, 1000);
+	EXPECT_EQ (NO_ERROR, rc, "init pool");
+
+	rc = tipc_pool_get(&pool);
+	if (rc >= 0) {
+		tipc_pool_put(&pool, (handle_t) rc, NO_ERROR);
+
+		/* give peer time to close it */
+		nanosleep (0, 0, 300 * MSEC);
+
+		/*
+		 * stale channel is dropped; the new one is closed by
+		 * closer1 as well, possibly before connect returns
+		 */
+		rc = tipc_pool_get(&pool);
+		EXPECT_EQ (1, pool.stats.stale, "stale chans");
+		if (rc >= 0)
+			close((handle_t) rc);
+	} else {
+		/* closed before connect completed: nothing to check */
+		EXPECT_EQ (ERR_CHANNEL_CLOSED, rc, "get closer1 chan");
+	}
+	tipc_pool_drain(&pool);
+
+	TEST_END
+}
+
+/*
+ *  tipc_call() against echo: plain, poll first and short reply buffer
+ */
+static void run_tipc_call_test(void)
+{
+	int rc;
+	handle_t chan;
+	uint8_t tx_buf[64];
+	uint8_t rx_buf[64];
+	char path[MAX_PORT_PATH_LEN];
+	iovec_t tx_iov = { .base = tx_buf, .len = sizeof(tx_buf) };
+	iovec_t rx_iov = { .base = rx_buf, .len = sizeof(rx_buf) };
+	ipc_msg_t tx_msg = {
+		.num_iov = 1, .iov = &tx_iov, .num_handles = 0, .handles = NULL,
+	};
+	ipc_msg_t rx_msg = {
+		.num_iov = 1, .iov = &rx_iov, .num_handles = 0, .handles = NULL,
+	};
+
+	TEST_BEGIN(__func__);
+
+	sprintf(path, "%s.srv.%s", SRV_PATH_BASE, "echo");
+	rc = sync_connect(path, 1000);
+	EXPECT_GE_ZERO (rc, "connect to echo");
+
+	if (rc >= 0) {
+		chan = (handle_t) rc;
+
+		for (uint i = 0; i < 100; i++) {
+			fill_test_buf(tx_buf, sizeof(tx_buf), (uint8_t)i);
+			memset(rx_buf, 0, sizeof(rx_buf));
+			rc = tipc_call(chan, &tx_msg, &rx_msg, 1000,
+			               (i & 1) ? TIPC_CALL_POLL_FIRST : 0);
+			EXPECT_EQ (64, rc, "tipc_call");
+			rc = memcmp(tx_buf, rx_buf, sizeof(tx_buf));
+			EXPECT_EQ (0, rc, "reply content");
+			if (!_all_ok)
+				break;
+		}
+
+		/* reply does not fit: reported, retired anyway */
+		rx_iov.len = sizeof(rx_buf) / 2;
+		rc = tipc_call(chan, &tx_msg, &rx_msg, 1000, 0);
+		EXPECT_EQ (ERR_TOO_BIG, rc, "short reply buffer");
+
+		rx_iov.len = sizeof(rx_buf);
+		rc = tipc_call(chan, &tx_msg, &rx_msg, 1000, 0);
+		EXPECT_EQ (64, rc, "call after short reply");
+
+		rc = close(chan);
+		EXPECT_EQ (NO_ERROR, rc, "close channel");
+	}
+
+	TEST_END
+}
 
 /****************************************************************************/
 
@@ -1457,6 +1777,7 @@ static void run_all_tests (void)
 	/* reset test state */
 	_tests_total  = 0;
 	_tests_failed = 0;
+	testreg_drop_suite("ipc");
 
 	/* positive tests */
 	run_port_create_test();
@@ -1466,6 +1787,9 @@ static void run_all_tests (void)
 	run_accept_test();
 	run_send_msg_test();
 	run_end_to_end_msg_test();
+	run_end_to_end_fc_msg_test();
+	run_conn_pool_test();
+	run_tipc_call_test();
 
 	run_connect_close_by_peer_test("closer1");
 	run_connect_close_by_peer_test("closer2");
@@ -1493,6 +1817,89 @@ static void run_all_tests (void)
 		TLOGI("Some tests FAILED\n");
 }
 
+/*
+ *  Take records from suites waiting in testreg_publish(). The port only
+ *  exists while collecting: tests here expect no handles besides ctrl.
+ */
+static void collect_test_records(void)
+{
+	int rc;
+	uevent_t uevt;
+	uuid_t peer_uuid;
+	handle_t port;
+
+	rc = port_create(TESTREG_PORT, TESTREG_PORT_MSG_NUM,
+	                 sizeof(struct testreg_rec), IPC_PORT_ALLOW_TA_CONNECT);
+	if (rc < 0) {
+		TLOGI("failed (%d) to create testreg port\n", rc);
+		return;
+	}
+	port = (handle_t) rc;
+
+	for (;;) {
+		rc = wait(port, &uevt, TESTREG_COLLECT_TIMEOUT);
+		if (rc != NO_ERROR || !(uevt.event & IPC_HANDLE_POLL_READY))
+			break; /* no more suites */
+
+		rc = accept(port, &peer_uuid);
+		if (rc < 0)
+			continue;
+
+		handle_t chan = (handle_t) rc;
+		rc = testreg_receive(chan, TESTREG_COLLECT_TIMEOUT);
+		TLOGI("collected %d test records\n", rc);
+		close(chan);
+	}
+
+	close(port);
+}
+
+static void run_regress(handle_t chan)
+{
+	int rc;
+
+	run_all_tests();
+	collect_test_records();
+
+	rc = testreg_report(chan, TESTREG_SLOWDOWN_PCT);
+	if (rc < 0)
+		testreg_printf(chan, "TESTREG error=%d", rc);
+}
+
+/*
+ *  Wait a bit for optional command on newly accepted ctrl channel
+ */
+static void get_ctrl_cmd(handle_t chan, char *cmd, size_t cmd_size)
+{
+	int rc;
+	uevent_t uevt;
+	iovec_t iov;
+	ipc_msg_t msg;
+	ipc_msg_info_t inf;
+
+	cmd[0] = '\0';
+
+	rc = wait(chan, &uevt, CTRL_CMD_TIMEOUT);
+	if (rc != NO_ERROR || !(uevt.event & IPC_HANDLE_POLL_MSG))
+		return;
+
+	rc = get_msg(chan, &inf);
+	if (rc != NO_ERROR)
+		return;
+
+	iov.base = cmd;
+	iov.len  = cmd_size - 1;
+	msg.num_iov = 1;
+	msg.iov     = &iov;
+	msg.num_handles = 0;
+	msg.handles = NULL;
+
+	rc = read_msg(chan, inf.id, 0, &msg);
+	put_msg(chan, inf.id);
+	if (rc > 0)
+		cmd[rc] = '\0';
+}
+
 /*
  *  Application entry point
  */
@@ -1502,6 +1909,8 @@ int main(void)
 	char path[MAX_PORT_PATH_LEN];
 	uuid_t peer_uuid;
 
+	MEMPROF_INIT(APP_MIN_STACK_SIZE);
+
 	TLOGI ("Welcome to IPC unittest!!!\n");
 
 	/* create control port and just wait on it */
@@ -1525,8 +1934,28 @@ int main(void)
 				/* get connection request */
 				rc = accept(uevt.handle, &peer_uuid);
 				if (rc >= 0) {
-					/* then run unittest test */
-					run_all_tests();
+					char cmd[CTRL_CMD_MAX_LEN];
+
+					/* check what we are asked to run */
+					get_ctrl_cmd((handle_t)rc, cmd, sizeof(cmd));
+
+					/* then run unittest test or benchmarks */
+					if (strcmp(cmd, CTRL_CMD_RUN_BENCH) == 0)
+						run_all_benchmarks();
+					else if (strcmp(cmd, CTRL_CMD_RUN_STRESS) == 0)
+						run_all_stress();
+					else if (strcmp(cmd, CTRL_CMD_RUN_REGRESS) == 0)
+						run_regress((handle_t)rc);
+					else if (strcmp(cmd, CTRL_CMD_SAVE_BASELINE) == 0)
+						testreg_printf((handle_t)rc,
+						    "TESTREG baseline saved=%d",
+						    testreg_save_baseline());
+					else
+						run_all_tests();
+
+					MEMPROF_REPORT("ipc-unittest-main",
+					               APP_MIN_HEAP_SIZE,
+					               APP_MIN_STACK_SIZE);
 
 					/* and close it */
 					close(rc);
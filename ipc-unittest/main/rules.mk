@@ -23,9 +23,18 @@ MODULE_INCLUDES += \
 MODULE_SRCS += \
 	$(LOCAL_DIR)/manifest.c \
 	$(LOCAL_DIR)/main.c \
+	$(LOCAL_DIR)/bench.c \
+	$(LOCAL_DIR)/bulk_bench.c \
+	$(LOCAL_DIR)/stress.c \
 
 MODULE_DEPS += \
 	app/trusty \
 	lib/libc-trusty \
+	app/sample/lib/memprof \
+	app/sample/lib/perf \
+	app/sample/lib/tipc_fc \
+	app/sample/lib/tipc_rpc \
+	app/sample/lib/tipc_pool \
+	app/sample/lib/testreg \
 
 include make/module.mk
@@ -0,0 +1,360 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <err.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <trusty_std.h>
+
+#define LOG_TAG "ipc-unittest-stress"
+
+#include <app/ipc_unittest/common.h>
+#include <lib/perf/perf_stats.h>
+
+#include "stress.h"
+
+/*
+ * Fan-in stress: open many channels to the datasink services, keep all of
+ * them full and let wait_any() tell us which one has room again. Since
+ * datasink only retires messages, this measures raw queue and wakeup
+ * costs as the number of handles grows.
+ */
+#define FANIN_MSG_SIZE        64      /* datasink ports take 64 byte msgs */
+#define FANIN_DURATION      (1000 * MSEC)
+#define FANIN_CONN_TIMEOUT    1000
+#define FANIN_WAIT_TIMEOUT    1000
+
+/* ctrl port and ctrl channel are already taken */
+#define FANIN_MAX_CHANS   (MAX_USER_HANDLES - 2)
+
+typedef struct fanin_chan {
+	handle_t handle;
+	const char *port;
+	uint64_t sent;
+	bool closed;
+} fanin_chan_t;
+
+static const char * const _fanin_ports[] = {
+	"datasink",
+	"ns_only",   /* TA connections are denied: expected to be skipped */
+	"ta_only",
+};
+
+static const uint _fanin_chan_cnts[] = { 1, 4, 16, FANIN_MAX_CHANS };
+
+/*
+ * Shard scaling: the same flood spread over the datasink ports of the
+ * first n srv instances, SHARD_CHANS_PER_INST channels each. Instances
+ * that are not running are found with a short probe and left out.
+ */
+#define SHARD_CHANS_PER_INST   4
+#define SHARD_PROBE_TIMEOUT  100
+#define SHARD_PORT_LEN        16
+
+static char _shard_port_buf[SRV_SHARD_CNT][SHARD_PORT_LEN];
+static const char *_shard_ports[SRV_SHARD_CNT];
+
+static fanin_chan_t _chans[FANIN_MAX_CHANS];
+static uint8_t _fanin_buf[FANIN_MSG_SIZE];
+static struct perf_stats _wait_stats;   /* wait_any() cost, ns */
+
+/****************************************************************************/
+
+/*
+ *  Open up to cnt channels spread round robin over specified ports
+ */
+static uint fanin_open(const char * const *ports, uint port_cnt, uint cnt)
+{
+	int rc;
+	uint opened = 0;
+	uint denied = 0;
+	uint failed = 0;
+	char path[MAX_PORT_PATH_LEN];
+
+	for (uint i = 0; i < cnt * port_cnt && opened < cnt; i++) {
+		const char *port = ports[i % port_cnt];
+
+		sprintf(path, "%s.srv.%s", SRV_PATH_BASE, port);
+		rc = sync_connect(path, FANIN_CONN_TIMEOUT);
+		if (rc == ERR_ACCESS_DENIED) {
+			denied++;
+			continue;
+		}
+		if (rc < 0) {
+			/* most likely out of handles on either side */
+			failed++;
+			if (failed > port_cnt)
+				break;
+			continue;
+		}
+
+		fanin_chan_t *ch = &_chans[opened];
+		ch->handle = (handle_t)rc;
+		ch->port = port;
+		ch->sent = 0;
+		ch->closed = false;
+
+		rc = set_cookie(ch->handle, ch);
+		if (rc != NO_ERROR) {
+			TLOGI("failed (%d) to set cookie on %d\n",
+			      rc, ch->handle);
+			close(ch->handle);
+			continue;
+		}
+		opened++;
+	}
+
+	if (opened < cnt) {
+		TLOGI("opened %u of %u channels (%u denied, %u failed)\n",
+		      opened, cnt, denied, failed);
+	}
+	return opened;
+}
+
+static void fanin_close(uint cnt)
+{
+	for (uint i = 0; i < cnt; i++) {
+		if (!_chans[i].closed)
+			close(_chans[i].handle);
+		_chans[i].closed = true;
+	}
+}
+
+/*
+ *  Send on channel until its queue is full
+ */
+static int fanin_fill(fanin_chan_t *ch)
+{
+	int rc;
+	iovec_t iov = { .base = _fanin_buf, .len = sizeof(_fanin_buf) };
+	ipc_msg_t msg = {
+		.num_iov = 1, .iov = &iov, .num_handles = 0, .handles = NULL,
+	};
+
+	for (;;) {
+		rc = send_msg(ch->handle, &msg);
+		if (rc == ERR_NOT_ENOUGH_BUFFER)
+			return NO_ERROR; /* wait for SEND_UNBLOCKED */
+		if (rc < 0)
+			return rc;
+		ch->sent++;
+	}
+}
+
+/*
+ *  Print aggregate throughput and per channel fairness.
+ *
+ *  Fairness is Jain's index (sum x)^2 / (n * sum x^2): 1000 per-mille
+ *  when every channel moved the same number of messages, 1000/n when a
+ *  single channel got everything.
+ */
+static int64_t fanin_report(const char *name, uint cnt, int64_t elapsed)
+{
+	uint64_t wakeups = _wait_stats.cnt;
+	uint64_t total = 0;
+	uint64_t sq_sum = 0;
+	uint64_t min = UINT64_MAX;
+	uint64_t max = 0;
+	uint64_t ns = elapsed > 0 ? (uint64_t)elapsed : 1;
+
+	for (uint i = 0; i < cnt; i++) {
+		uint64_t s = _chans[i].sent;
+
+		total += s;
+		sq_sum += s * s;
+		min = MIN(min, s);
+		max = MAX(max, s);
+	}
+
+	uint64_t fairness = sq_sum ? (total * total * 1000) / (cnt * sq_sum) : 0;
+	uint64_t msgs_ps = total * 1000000000ULL / ns;
+	uint64_t kb_ps = msgs_ps * FANIN_MSG_SIZE / 1024;
+
+	perf_print_stats("ipc", name, &_wait_stats, "ns");
+	perf_print_value("ipc", name, "msgs", msgs_ps, "msgs/s");
+	perf_print_value("ipc", name, "bw", kb_ps, "KB/s");
+	perf_print_value("ipc", name, "per_wakeup",
+	                 wakeups ? total / wakeups : 0, "msgs");
+	perf_print_value("ipc", name, "chan_min", min, "msgs");
+	perf_print_value("ipc", name, "chan_max", max, "msgs");
+	perf_print_value("ipc", name, "fairness", fairness, "permille");
+	return (int64_t)msgs_ps;
+}
+
+/*
+ *  Flood cnt channels at once for FANIN_DURATION, returns msgs/s
+ */
+static int64_t run_fanin(const char *name, const char * const *ports,
+                         uint port_cnt, uint cnt)
+{
+	int rc = NO_ERROR;
+	uint alive;
+	int64_t t0, t1, deadline, msgs_ps;
+
+	cnt = fanin_open(ports, port_cnt, cnt);
+	if (!cnt)
+		return ERR_NOT_FOUND;
+
+	memset(_fanin_buf, 0xA5, sizeof(_fanin_buf));
+	perf_stats_reset(&_wait_stats);
+
+	t0 = perf_now_ns();
+	deadline = t0 + FANIN_DURATION;
+
+	/* prime every queue */
+	for (uint i = 0; i < cnt; i++) {
+		rc = fanin_fill(&_chans[i]);
+		if (rc != NO_ERROR)
+			goto err_fill;
+	}
+
+	/* then refill whichever channel wait_any reports has room */
+	alive = cnt;
+	while (alive && perf_now_ns() < deadline) {
+		uevent_t uevt;
+		int64_t tw = perf_now_ns();
+
+		rc = wait_any(&uevt, FANIN_WAIT_TIMEOUT);
+		perf_stats_add(&_wait_stats, perf_now_ns() - tw);
+		if (rc != NO_ERROR)
+			goto err_wait;
+
+		fanin_chan_t *ch = uevt.cookie;
+		if (ch < &_chans[0] || ch >= &_chans[cnt]) {
+			/* a late SEND_UNBLOCKED is reported once... */
+			if (uevt.event == IPC_HANDLE_POLL_SEND_UNBLOCKED)
+				continue;
+			/*
+			 * ...but ctrl port connections and ctrl channel
+			 * messages or HUP stay pending: we cannot consume
+			 * them here and wait_any would spin on them
+			 */
+			TLOGI("event 0x%x on foreign handle %d\n",
+			      uevt.event, uevt.handle);
+			rc = ERR_BUSY;
+			goto err_wait;
+		}
+
+		if (uevt.event & (IPC_HANDLE_POLL_HUP | IPC_HANDLE_POLL_ERROR)) {
+			TLOGI("chan %d to %s closed by peer\n",
+			      ch->handle, ch->port);
+			close(ch->handle);
+			ch->closed = true;
+			alive--;
+			continue;
+		}
+
+		if (uevt.event & IPC_HANDLE_POLL_SEND_UNBLOCKED) {
+			rc = fanin_fill(ch);
+			if (rc != NO_ERROR)
+				goto err_fill;
+		}
+	}
+	t1 = perf_now_ns();
+
+	msgs_ps = fanin_report(name, cnt, t1 - t0);
+	fanin_close(cnt);
+	return msgs_ps;
+
+err_wait:
+err_fill:
+	TLOGI("%s with %u chans failed (%d)\n", name, cnt, rc);
+	fanin_close(cnt);
+	return rc;
+}
+
+/*
+ *  Count srv instances serving datasink, stopping at first missing one
+ */
+static uint shard_probe(void)
+{
+	int rc;
+	uint cnt;
+	char path[MAX_PORT_PATH_LEN];
+
+	for (cnt = 0; cnt < SRV_SHARD_CNT; cnt++) {
+		if (cnt)
+			snprintf(_shard_port_buf[cnt], SHARD_PORT_LEN,
+			         "datasink.s%u", cnt);
+		else
+			strcpy(_shard_port_buf[cnt], "datasink");
+		_shard_ports[cnt] = _shard_port_buf[cnt];
+
+		sprintf(path, "%s.srv.%s", SRV_PATH_BASE, _shard_ports[cnt]);
+		rc = sync_connect(path, SHARD_PROBE_TIMEOUT);
+		if (rc < 0)
+			break;
+		close((handle_t)rc);
+	}
+	return cnt;
+}
+
+/*
+ *  Aggregate datasink throughput as srv instances are added
+ */
+static uint run_shard_scaling(void)
+{
+	uint failed = 0;
+	int64_t base = 0;
+	char name[32];
+	uint inst_cnt = shard_probe();
+
+	TLOGI("%u of %u srv instance(s) running\n", inst_cnt, SRV_SHARD_CNT);
+
+	for (uint n = 1; n <= inst_cnt; n++) {
+		snprintf(name, sizeof(name), "shard.inst%u", n);
+		int64_t msgs_ps = run_fanin(name, _shard_ports, n,
+		                            n * SHARD_CHANS_PER_INST);
+		if (msgs_ps < 0) {
+			failed++;
+			continue;
+		}
+		if (n == 1)
+			base = msgs_ps;
+		perf_print_value("ipc", name, "scaling",
+		                 base ? msgs_ps * 1000 / base : 0, "permille");
+	}
+	return failed;
+}
+
+/*
+ *  Sweep number of concurrently flooded datasink channels
+ */
+void run_all_stress(void)
+{
+	uint failed = 0;
+	char name[32];
+
+	TLOGI("Run datasink fan-in stress\n");
+
+	for (uint i = 0; i < countof(_fanin_chan_cnts); i++) {
+		snprintf(name, sizeof(name), "fanin.chans%u",
+		         _fanin_chan_cnts[i]);
+		if (run_fanin(name, _fanin_ports, countof(_fanin_ports),
+		              _fanin_chan_cnts[i]) < 0)
+			failed++;
+	}
+
+	TLOGI("Run srv shard scaling\n");
+	failed += run_shard_scaling();
+
+	if (failed)
+		TLOGI("%u stress run(s) FAILED\n", failed);
+	else
+		TLOGI("All stress runs completed\n");
+}
@@ -18,18 +18,29 @@
 #include <stddef.h>
 #include <stdio.h>
 
+#include "manifest.h"
+
+#ifdef IPC_UNITTEST_SRV_SHARD
+#include <trusty_std.h>
+#include <app/ipc_unittest/common.h>
+#endif
+
 trusty_app_manifest_t TRUSTY_APP_MANIFEST_ATTRS trusty_app_manifest =
 {
+#ifdef IPC_UNITTEST_SRV_SHARD
+	.uuid = IPC_UNITTEST_SRV_SHARD_APP_UUID(IPC_UNITTEST_SRV_SHARD),
+#else
 	.uuid = IPC_UNITTEST_SRV_APP_UUID,
+#endif
 
 	/* optional configuration options here */
 	.config_options =
 	{
-		/* four pages for heap */
-		TRUSTY_APP_CONFIG_MIN_HEAP_SIZE(4 * 4096),
+		/* eight pages for heap: channel state slab plus port states */
+		TRUSTY_APP_CONFIG_MIN_HEAP_SIZE(APP_MIN_HEAP_SIZE),
 
 		/* 2 pages for stack */
-		TRUSTY_APP_CONFIG_MIN_STACK_SIZE(2 * 4096),
+		TRUSTY_APP_CONFIG_MIN_STACK_SIZE(APP_MIN_STACK_SIZE),
 	},
 };
 
@@ -27,5 +27,9 @@ MODULE_SRCS += \
 MODULE_DEPS += \
 	app/trusty \
 	lib/libc-trusty \
+	app/sample/lib/memprof \
+	app/sample/lib/tipc_fc \
+	app/sample/lib/tipc_rpc \
+	app/sample/lib/tipc_srv \
 
 include make/module.mk
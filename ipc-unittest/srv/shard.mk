@@ -0,0 +1,41 @@
+# Copyright (C) 2016 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+#
+# Template for srv shard instances. The including rules.mk sets LOCAL_DIR
+# to its own directory and IPC_UNITTEST_SRV_SHARD to the shard number.
+#
+
+MODULE := $(LOCAL_DIR)
+
+MODULE_INCLUDES += \
+	$(LOCAL_DIR)/../include \
+
+MODULE_SRCS += \
+	$(LOCAL_DIR)/../srv/manifest.c \
+	$(LOCAL_DIR)/../srv/srv.c \
+
+MODULE_DEFINES += \
+	IPC_UNITTEST_SRV_SHARD=$(IPC_UNITTEST_SRV_SHARD) \
+
+MODULE_DEPS += \
+	app/trusty \
+	lib/libc-trusty \
+	app/sample/lib/memprof \
+	app/sample/lib/tipc_fc \
+	app/sample/lib/tipc_rpc \
+	app/sample/lib/tipc_srv \
+
+include make/module.mk
@@ -26,31 +26,13 @@
 #define LOG_TAG "ipc-unittest-srv"
 
 #include <app/ipc_unittest/common.h>
+#include <app/ipc_unittest/bulk.h>
+#include <lib/tipc_fc/tipc_fc.h>
+#include <lib/tipc_rpc/tipc_rpc.h>
+#include <lib/tipc_srv/tipc_srv.h>
+#include <lib/memprof/memprof.h>
 
-typedef void (*event_handler_proc_t) (const uevent_t *ev);
-
-typedef struct tipc_event_handler {
-	event_handler_proc_t proc;
-	void *priv;
-} tipc_event_handler_t;
-
-typedef struct tipc_srv {
-	const char *name;
-	uint   msg_num;
-	size_t msg_size;
-	uint   port_flags;
-	size_t port_state_size;
-	size_t chan_state_size;
-	event_handler_proc_t port_handler;
-	event_handler_proc_t chan_handler;
-} tipc_srv_t;
-
-typedef struct tipc_srv_state {
-	const struct tipc_srv *service;
-	handle_t port;
-	void *priv;
-	tipc_event_handler_t handler;
-} tipc_srv_state_t;
+#include "manifest.h"
 
 /* closer services */
 static void closer1_handle_port(const uevent_t *ev);
@@ -91,8 +73,27 @@ static struct tipc_event_handler _datasink_chan_handler = {
 static void echo_handle_port(const uevent_t *ev);
 static void echo_handle_chan(const uevent_t *ev);
 
+/*
+ * Echo payloads are read into segments taken from a small static pool
+ * and sent back from the same segments, so a message that the kernel
+ * could not take (ERR_NOT_ENOUGH_BUFFER) is resent later without being
+ * read again, and large messages never need one contiguous buffer.
+ *
+ * A request is retired as soon as its content is held in segments and
+ * before the reply goes out, so a client that counts one credit per
+ * unanswered request (see lib/tipc_fc) never finds the queue full.
+ */
+#define ECHO_SEG_SIZE   512
+#define ECHO_SEG_CNT    16
+#define ECHO_MAX_IOV    (MAX_PORT_BUF_SIZE / ECHO_SEG_SIZE)
+
 typedef struct echo_chan_state {
 	struct tipc_event_handler handler;
+	handle_t chan;
+	struct list_node starved_node;  /* waiting for free segments */
+	struct tipc_fc fc;              /* replies toward client */
+	uint fwd_num_iov;               /* segments holding pending reply */
+	iovec_t fwd_iov[ECHO_MAX_IOV];
 	uint msg_max_num;
 	uint msg_cnt;
 	uint msg_next_r;
@@ -100,19 +101,46 @@ typedef struct echo_chan_state {
 	struct ipc_msg_info msg_queue[0];
 } echo_chan_state_t;
 
+#define ECHO_CHAN_STATE_SIZE(msg_num) \
+	(sizeof(echo_chan_state_t) + sizeof(ipc_msg_info_t) * (msg_num))
+
+/* bulk service */
+static void bulk_handle_port(const uevent_t *ev);
+static void bulk_handle_chan(const uevent_t *ev);
+
+typedef struct bulk_chan_state {
+	struct tipc_event_handler handler;
+	handle_t chan;
+	bool active;             /* BEGIN received, payload expected */
+	uint32_t xfer_id;
+	uint32_t len;
+	uint32_t left;
+	uint32_t csum;
+} bulk_chan_state_t;
+
 /* uuid service */
 static void uuid_handle_port(const uevent_t *ev);
 
-/* Other globals */
-static bool stopped = false;
-
 /************************************************************************/
 
 #define IPC_PORT_ALLOW_ALL  (  IPC_PORT_ALLOW_NS_CONNECT \
                              | IPC_PORT_ALLOW_TA_CONNECT \
                             )
 
-#define SRV_NAME(name)   SRV_PATH_BASE ".srv." name
+/*
+ * Shard instances (srv-shardN) are built from this file with
+ * IPC_UNITTEST_SRV_SHARD=N and serve the same table with ".sN" appended
+ * to every port name. The primary instance keeps plain names.
+ */
+#ifdef IPC_UNITTEST_SRV_SHARD
+#define _SRV_STR(x)        #x
+#define SRV_STR(x)         _SRV_STR(x)
+#define SRV_SHARD_SUFFIX   ".s" SRV_STR(IPC_UNITTEST_SRV_SHARD)
+#else
+#define SRV_SHARD_SUFFIX   ""
+#endif
+
+#define SRV_NAME(name)   SRV_PATH_BASE ".srv." name SRV_SHARD_SUFFIX
 
 
 static const struct tipc_srv _services[] =
@@ -180,12 +208,61 @@ static const struct tipc_srv _services[] =
 	/* echo */
 	{
 		.name = SRV_NAME("echo"),
-		.msg_num = 8,
+		.msg_num = ECHO_MSG_NUM,
 		.msg_size = MAX_PORT_BUF_SIZE,
 		.port_flags = IPC_PORT_ALLOW_ALL,
 		.port_handler = echo_handle_port,
+		.chan_state_size = ECHO_CHAN_STATE_SIZE(ECHO_MSG_NUM),
 		.chan_handler = echo_handle_chan,
 	},
+	/* echo with different queue depth (benchmarks) */
+	{
+		.name = SRV_NAME("echo.q1"),
+		.msg_num = 1,
+		.msg_size = MAX_PORT_BUF_SIZE,
+		.port_flags = IPC_PORT_ALLOW_ALL,
+		.port_handler = echo_handle_port,
+		.chan_state_size = ECHO_CHAN_STATE_SIZE(1),
+		.chan_handler = echo_handle_chan,
+	},
+	{
+		.name = SRV_NAME("echo.q2"),
+		.msg_num = 2,
+		.msg_size = MAX_PORT_BUF_SIZE,
+		.port_flags = IPC_PORT_ALLOW_ALL,
+		.port_handler = echo_handle_port,
+		.chan_state_size = ECHO_CHAN_STATE_SIZE(2),
+		.chan_handler = echo_handle_chan,
+	},
+	{
+		.name = SRV_NAME("echo.q4"),
+		.msg_num = 4,
+		.msg_size = MAX_PORT_BUF_SIZE,
+		.port_flags = IPC_PORT_ALLOW_ALL,
+		.port_handler = echo_handle_port,
+		.chan_state_size = ECHO_CHAN_STATE_SIZE(4),
+		.chan_handler = echo_handle_chan,
+	},
+	{
+		.name = SRV_NAME("echo.q16"),
+		.msg_num = 16,
+		.msg_size = MAX_PORT_BUF_SIZE,
+		.port_flags = IPC_PORT_ALLOW_ALL,
+		.port_handler = echo_handle_port,
+		.chan_state_size = ECHO_CHAN_STATE_SIZE(16),
+		.chan_handler = echo_handle_chan,
+	},
+	/* bulk transfers */
+	{
+		.name = SRV_NAME("bulk"),
+		.msg_num = BULK_MSG_NUM,
+		.msg_size = BULK_MSG_SIZE,
+		.port_flags = IPC_PORT_ALLOW_ALL,
+		.port_handler = bulk_handle_port,
+		.chan_state_size = sizeof(bulk_chan_state_t),
+		.max_chan_cnt = 2,
+		.chan_handler = bulk_handle_chan,
+	},
 	/* uuid  test */
 	{
 		.name = SRV_NAME("uuid"),
@@ -197,168 +274,7 @@ static const struct tipc_srv _services[] =
 	},
 };
 
-static struct tipc_srv_state _srv_states[countof(_services)] = {
-	[0 ... (countof(_services) - 1)] = {
-		.port = INVALID_IPC_HANDLE,
-	},
-};
-
-/************************************************************************/
-
-static struct tipc_srv_state *get_srv_state(const uevent_t *ev)
-{
-	return containerof(ev->cookie, struct tipc_srv_state, handler);
-}
-
-static void _destroy_service(struct tipc_srv_state *state)
-{
-	if (!state) {
-		TLOGI("non-null state expected\n");
-		return;
-	}
-
-	/* free state if any */
-	if (state->priv) {
-		free(state->priv);
-		state->priv = NULL;
-	}
-
-	/* close port */
-	if (state->port != INVALID_IPC_HANDLE) {
-		int rc = close(state->port);
-		if (rc != NO_ERROR) {
-			TLOGI("Failed (%d) to close port %d\n",
-			       rc, state->port);
-		}
-		state->port = INVALID_IPC_HANDLE;
-	}
-
-	/* reset handler */
-	state->service = NULL;
-	state->handler.proc = NULL;
-	state->handler.priv = NULL;
-}
-
-
-/*
- *  Create service
- */
-static int _create_service(const struct tipc_srv *srv,
-                           struct tipc_srv_state *state)
-{
-	if (!srv || !state) {
-		TLOGI("null service specified: %p: %p\n");
-		return ERR_INVALID_ARGS;
-	}
-
-	/* create port */
-	int rc = port_create(srv->name, srv->msg_num, srv->msg_size,
-			     srv->port_flags);
-	if (rc < 0) {
-		TLOGI("Failed (%d) to create port\n", rc);
-		return rc;
-	}
-
-	/* setup port state  */
-	state->port = (handle_t)rc;
-	state->handler.proc = srv->port_handler;
-	state->handler.priv = state;
-	state->service = srv;
-	state->priv = NULL;
-
-	if (srv->port_state_size) {
-		/* allocate port state */
-		state->priv = calloc(1, srv->port_state_size);
-		if (!state->priv) {
-			rc = ERR_NO_MEMORY;
-			goto err_calloc;
-		}
-	}
-
-	/* attach handler to port handle */
-	rc = set_cookie(state->port, &state->handler);
-	if (rc < 0) {
-		TLOGI("Failed (%d) to set cookie on port %d\n",
-		      rc, state->port);
-		goto err_set_cookie;
-	}
-
-	return NO_ERROR;
-
-err_calloc:
-err_set_cookie:
-	_destroy_service(state);
-	return rc;
-}
-
-
-/*
- *  Restart specified service
- */
-static int restart_service(struct tipc_srv_state *state)
-{
-	if (!state) {
-		TLOGI("non-null state expected\n");
-		return ERR_INVALID_ARGS;
-	}
-
-	const struct tipc_srv *srv = state->service;
-	_destroy_service(state);
-	return _create_service(srv, state);
-}
-
-/*
- *  Kill all servoces
- */
-static void kill_services(void)
-{
-	TLOGI ("Terminating unittest services\n");
-
-	/* close any opened ports */
-	for (uint i = 0; i < countof(_services); i++) {
-		_destroy_service(&_srv_states[i]);
-	}
-}
-
-/*
- *  Initialize all services
- */
-static int init_services(void)
-{
-	TLOGI ("Init unittest services!!!\n");
-
-	for (uint i = 0; i < countof(_services); i++) {
-		int rc = _create_service(&_services[i], &_srv_states[i]);
-		if (rc < 0) {
-			TLOGI("Failed (%d) to create service %s\n",
-			      rc, _services[i].name);
-			return rc;
-		}
-	}
-
-	return 0;
-}
-
-/*
- *  Handle common port errors
- */
-static bool handle_port_errors(const uevent_t *ev)
-{
-	if ((ev->event & IPC_HANDLE_POLL_ERROR) ||
-	    (ev->event & IPC_HANDLE_POLL_HUP) ||
-	    (ev->event & IPC_HANDLE_POLL_MSG) ||
-	    (ev->event & IPC_HANDLE_POLL_SEND_UNBLOCKED)) {
-		/* should never happen with port handles */
-		TLOGI("error event (0x%x) for port (%d)\n",
-		       ev->event, ev->handle);
-
-		/* recreate service */
-		restart_service(get_srv_state(ev));
-		return true;
-	}
-
-	return false;
-}
+TIPC_SRV_CTX_DEFINE(_srv_ctx, _services);
 
 /****************************** connect test service *********************/
 
@@ -395,7 +311,7 @@ static void connect_handle_port(const uevent_t *ev)
 {
 	uuid_t peer_uuid;
 
-	if (handle_port_errors(ev))
+	if (tipc_handle_port_errors(ev))
 		return;
 
 	if (ev->event & IPC_HANDLE_POLL_READY) {
@@ -425,9 +341,9 @@ static void connect_handle_port(const uevent_t *ev)
 static void closer1_handle_port(const uevent_t *ev)
 {
 	uuid_t peer_uuid;
-	struct closer1_state *st = get_srv_state(ev)->priv;
+	struct closer1_state *st = tipc_get_srv_state(ev)->priv;
 
-	if (handle_port_errors(ev))
+	if (tipc_handle_port_errors(ev))
 		return;
 
 	if (ev->event & IPC_HANDLE_POLL_READY) {
@@ -456,9 +372,9 @@ static void closer1_handle_port(const uevent_t *ev)
 
 static void closer2_handle_port(const uevent_t *ev)
 {
-	struct closer2_state *st = get_srv_state(ev)->priv;
+	struct closer2_state *st = tipc_get_srv_state(ev)->priv;
 
-	if (handle_port_errors(ev))
+	if (tipc_handle_port_errors(ev))
 		return;
 
 	if (ev->event & IPC_HANDLE_POLL_READY) {
@@ -473,16 +389,16 @@ static void closer2_handle_port(const uevent_t *ev)
 		 * then close the port without accepting any connections
 		 * and restart it again
 		 */
-		restart_service(get_srv_state(ev));
+		tipc_restart_service(tipc_get_srv_state(ev));
 	}
 }
 
 static void closer3_handle_port(const uevent_t *ev)
 {
 	uuid_t peer_uuid;
-	struct closer3_state *st = get_srv_state(ev)->priv;
+	struct closer3_state *st = tipc_get_srv_state(ev)->priv;
 
-	if (handle_port_errors(ev))
+	if (tipc_handle_port_errors(ev))
 		return;
 
 	if (ev->event & IPC_HANDLE_POLL_READY) {
@@ -580,7 +496,7 @@ static void datasink_handle_port(const uevent_t *ev)
 {
 	uuid_t peer_uuid;
 
-	if (handle_port_errors(ev))
+	if (tipc_handle_port_errors(ev))
 		return;
 
 	if (ev->event & IPC_HANDLE_POLL_READY) {
@@ -603,24 +519,130 @@ static void datasink_handle_port(const uevent_t *ev)
 
 /******************************   echo service    **************************/
 
-static uint8_t echo_msg_buf[MAX_PORT_BUF_SIZE];
+static uint8_t echo_seg_pool[ECHO_SEG_CNT][ECHO_SEG_SIZE];
+static uint32_t echo_seg_busy;  /* bitmap of segments in use */
+static struct list_node echo_starved_list =
+	LIST_INITIAL_VALUE(echo_starved_list);
+
+static uint echo_free_seg_cnt(void)
+{
+	return ECHO_SEG_CNT - __builtin_popcount(echo_seg_busy);
+}
+
+/*
+ *  Attach enough pool segments to channel state to hold len bytes
+ */
+static int echo_get_segs(echo_chan_state_t *st, size_t len)
+{
+	uint cnt = len ? (len + ECHO_SEG_SIZE - 1) / ECHO_SEG_SIZE : 1;
+
+	if (cnt > ECHO_MAX_IOV)
+		return ERR_TOO_BIG;
+
+	if (cnt > echo_free_seg_cnt())
+		return ERR_NO_RESOURCES;
 
-static int _echo_handle_msg(const uevent_t *ev, int delay)
+	for (uint i = 0; i < cnt; i++) {
+		uint idx = __builtin_ctz(~echo_seg_busy);
+		echo_seg_busy |= 1U << idx;
+		st->fwd_iov[i].base = echo_seg_pool[idx];
+		st->fwd_iov[i].len  = ECHO_SEG_SIZE;
+	}
+	st->fwd_num_iov = cnt;
+
+	return NO_ERROR;
+}
+
+/*
+ *  Return segments held by channel state back to pool
+ */
+static void echo_put_segs(echo_chan_state_t *st)
+{
+	for (uint i = 0; i < st->fwd_num_iov; i++) {
+		uint idx = ((uint8_t *)st->fwd_iov[i].base -
+		            &echo_seg_pool[0][0]) / ECHO_SEG_SIZE;
+		echo_seg_busy &= ~(1U << idx);
+	}
+	st->fwd_num_iov = 0;
+}
+
+/*
+ *  Read message content into pool segments (scatter)
+ */
+static int echo_read_msg(echo_chan_state_t *st, const ipc_msg_info_t *inf)
+{
+	int rc;
+	ipc_msg_t msg;
+
+	rc = echo_get_segs(st, inf->len);
+	if (rc != NO_ERROR)
+		return rc;
+
+	msg.num_iov = st->fwd_num_iov;
+	msg.iov     = st->fwd_iov;
+	msg.num_handles = 0;
+	msg.handles  = NULL;
+
+	rc = read_msg(st->chan, inf->id, 0, &msg);
+	if (rc < 0) {
+		echo_put_segs(st);
+		return rc;
+	}
+
+	/* trim segment list to number of bytes received */
+	size_t left = (size_t)rc;
+	for (uint i = 0; i < st->fwd_num_iov; i++) {
+		st->fwd_iov[i].len = MIN(left, (size_t)ECHO_SEG_SIZE);
+		left -= st->fwd_iov[i].len;
+	}
+
+	return NO_ERROR;
+}
+
+/*
+ *  Send back reply held in segments, if any
+ */
+static int echo_send_pending(echo_chan_state_t *st)
+{
+	long rc;
+	ipc_msg_t msg;
+
+	if (!st->fwd_num_iov)
+		return NO_ERROR;
+
+	msg.num_iov = st->fwd_num_iov;
+	msg.iov     = st->fwd_iov;
+	msg.num_handles = 0;
+	msg.handles  = NULL;
+
+	rc = tipc_fc_send(&st->fc, st->chan, &msg);
+	if (rc == ERR_NOT_ENOUGH_BUFFER)
+		return rc; /* keep content until SEND_UNBLOCKED */
+
+	if (rc < 0) {
+		TLOGI("failed (%ld) to send_msg for chan (%d)\n",
+		      rc, st->chan);
+		return (int)rc;
+	}
+
+	echo_put_segs(st);
+	return NO_ERROR;
+}
+
+static int _echo_handle_msg(echo_chan_state_t *st, int delay)
 {
 	int rc;
-	iovec_t iov;
 	ipc_msg_t msg;
-	echo_chan_state_t *st = containerof(ev->cookie, echo_chan_state_t, handler);
 
 	/* get all messages */
 	while (st->msg_cnt != st->msg_max_num) {
-		rc = get_msg(ev->handle, &st->msg_queue[st->msg_next_w]);
+		rc = get_msg(st->chan, &st->msg_queue[st->msg_next_w]);
 		if (rc == ERR_NO_MSG)
 			break; /* no new messages */
 
 		if (rc != NO_ERROR) {
 			TLOGI("failed (%d) to get_msg for chan (%d)\n",
-			      rc, ev->handle);
+			      rc, st->chan);
 			return rc;
 		}
 
@@ -630,63 +652,102 @@ static int _echo_handle_msg(const uevent_t *ev, int delay)
 			st->msg_next_w = 0;
 	}
 
-	/* handle all messages in queue */
-	while (st->msg_cnt) {
-		/* init message structure */
-		iov.base = echo_msg_buf;
-		iov.len  = sizeof(echo_msg_buf);
-		msg.num_iov = 1;
-		msg.iov     = &iov;
-		msg.num_handles = 0;
-		msg.handles  = NULL;
+	for (;;) {
+		/* reply has to go out before next request can be read */
+		rc = echo_send_pending(st);
+		if (rc == ERR_NOT_ENOUGH_BUFFER)
+			break;
+		if (rc != NO_ERROR)
+			return rc;
+
+		if (!st->msg_cnt)
+			break;
+
+		ipc_msg_info_t *inf = &st->msg_queue[st->msg_next_r];
 
-		/* read msg content */
-		rc = read_msg(ev->handle, st->msg_queue[st->msg_next_r].id, 0, &msg);
+		/* read msg content (scatter) */
+		rc = echo_read_msg(st, inf);
+		if (rc == ERR_NO_RESOURCES) {
+			/* retry when other channels return segments */
+			if (!list_in_list(&st->starved_node))
+				list_add_tail(&echo_starved_list,
+				              &st->starved_node);
+			break;
+		}
 		if (rc < 0) {
 			TLOGI("failed (%d) to read_msg for chan (%d)\n",
-			      rc, ev->handle);
+			      rc, st->chan);
 			return rc;
 		}
 
-		/* update number of bytes received */
-		iov.len = (size_t) rc;
-
 		/* optionally sleep a bit an send it back */
 		if (delay) {
 			nanosleep (0, 0, 1000);
 		}
 
-		/* and send it back */
-		rc = send_msg(ev->handle, &msg);
-		if (rc == ERR_NOT_ENOUGH_BUFFER)
-			break;
-
-		if (rc < 0) {
-			TLOGI("failed (%d) to send_msg for chan (%d)\n",
-			      rc, ev->handle);
-			return rc;
-		}
+		/* retire original message and send it back (gather) */
+		msg.num_iov = st->fwd_num_iov;
+		msg.iov     = st->fwd_iov;
+		msg.num_handles = 0;
+		msg.handles  = NULL;
 
-		/* retire original message */
-		rc = put_msg(ev->handle, st->msg_queue[st->msg_next_r].id);
-		if (rc != NO_ERROR) {
-			TLOGI("failed (%d) to put_msg for chan (%d)\n",
-			      rc, ev->handle);
-			return rc;
-		}
+		long ret = tipc_reply(st->chan, inf->id, &msg, &st->fc);
 
-		/* advance queue */
+		/* advance queue: request is retired even if reply waits */
 		st->msg_cnt--;
 		st->msg_next_r++;
 		if (st->msg_next_r == st->msg_max_num)
 			st->msg_next_r = 0;
+
+		if (ret == ERR_NOT_ENOUGH_BUFFER)
+			break; /* keep content until SEND_UNBLOCKED */
+
+		if (ret < 0) {
+			TLOGI("failed (%ld) to reply on chan (%d)\n",
+			      ret, st->chan);
+			return (int)ret;
+		}
+
+		echo_put_segs(st);
 	}
 	return NO_ERROR;
 }
 
-static int echo_handle_msg(const uevent_t *ev)
+static int echo_handle_msg(echo_chan_state_t *st)
+{
+	return _echo_handle_msg(st, false);
+}
+
+static void echo_close_chan(echo_chan_state_t *st)
 {
-	return _echo_handle_msg(ev, false);
+	echo_put_segs(st);
+	if (list_in_list(&st->starved_node))
+		list_delete(&st->starved_node);
+	close(st->chan);
+	tipc_chan_state_free(st);
+}
+
+/*
+ *  Give channels waiting for segments another chance
+ */
+static void echo_kick_starved(void)
+{
+	struct list_node list = LIST_INITIAL_VALUE(list);
+	echo_chan_state_t *st;
+
+	if (list_is_empty(&echo_starved_list) || !echo_free_seg_cnt())
+		return;
+
+	/* take current waiters: they requeue themselves if still starved */
+	while ((st = list_remove_head_type(&echo_starved_list,
+	                                   echo_chan_state_t, starved_node)))
+		list_add_tail(&list, &st->starved_node);
+
+	while ((st = list_remove_head_type(&list,
+	                                   echo_chan_state_t, starved_node))) {
+		if (echo_handle_msg(st) != NO_ERROR)
+			echo_close_chan(st);
+	}
 }
 
 /*
@@ -694,6 +755,9 @@ static int echo_handle_msg(const uevent_t *ev)
  */
 static void echo_handle_chan(const uevent_t *ev)
 {
+	echo_chan_state_t *st = containerof(ev->cookie, echo_chan_state_t,
+	                                    handler);
+
 	if (ev->event & IPC_HANDLE_POLL_ERROR) {
 		/* close it as it is in an error state */
 		TLOGI("error event (0x%x) for chan (%d)\n",
@@ -703,7 +767,8 @@ static void echo_handle_chan(const uevent_t *ev)
 
 	if (ev->event & (IPC_HANDLE_POLL_MSG |
 		         IPC_HANDLE_POLL_SEND_UNBLOCKED)) {
-		if (echo_handle_msg(ev) != 0) {
+		tipc_fc_handle_event(&st->fc, ev->event);
+		if (echo_handle_msg(st) != 0) {
 			TLOGI("error event (0x%x) for chan (%d)\n",
 			      ev->event, ev->handle);
 			goto close_it;
@@ -714,11 +779,12 @@ static void echo_handle_chan(const uevent_t *ev)
 		goto close_it;
 	}
 
+	echo_kick_starved();
 	return;
 
 close_it:
-	free(ev->cookie);
-	close(ev->handle);
+	echo_close_chan(st);
+	echo_kick_starved();
 }
 
 /*
@@ -728,9 +794,10 @@ static void echo_handle_port(const uevent_t *ev)
 {
 	uuid_t peer_uuid;
 	struct echo_chan_state *chan_st;
-	const struct tipc_srv *srv = get_srv_state(ev)->service;
+	struct tipc_srv_state *state = tipc_get_srv_state(ev);
+	const struct tipc_srv *srv = state->service;
 
-	if (handle_port_errors(ev))
+	if (tipc_handle_port_errors(ev))
 		return;
 
 	if (ev->event & IPC_HANDLE_POLL_READY) {
@@ -745,17 +812,17 @@ static void echo_handle_port(const uevent_t *ev)
 		}
 		chan = (handle_t) rc;
 
-		chan_st = calloc(1, sizeof(struct echo_chan_state) +
-		                    sizeof(ipc_msg_info_t) * srv->msg_num);
+		chan_st = tipc_chan_state_alloc(state);
 		if (!chan_st) {
-			TLOGI("failed (%d) to callocate state for chan %d\n",
-			       rc, chan);
+			TLOGI("no channel state: closing chan %d\n", chan);
 			close(chan);
 			return;
 		}
 
 		/* init state */
+		chan_st->chan = chan;
 		chan_st->msg_max_num  = srv->msg_num;
+		tipc_fc_init(&chan_st->fc, 0);
 		chan_st->handler.proc = srv->chan_handler;
 		chan_st->handler.priv = chan_st;
 
@@ -764,7 +831,7 @@ static void echo_handle_port(const uevent_t *ev)
 		if (rc) {
 			TLOGI("failed (%d) to set_cookie on chan %d\n",
 			       rc, chan);
-			free(chan_st);
+			tipc_chan_state_free(chan_st);
 			close(chan);
 			return;
 		}
@@ -772,6 +839,189 @@ static void echo_handle_port(const uevent_t *ev)
 }
 
 
+/******************************   bulk service    **************************/
+
+/* payload is consumed right away, so all channels share one buffer */
+static uint8_t bulk_buf[BULK_MSG_SIZE];
+
+static int bulk_send_done(bulk_chan_state_t *st, int32_t status)
+{
+	int rc;
+	struct bulk_ctrl done = {
+		.cmd = BULK_CMD_DONE,
+		.xfer_id = st->xfer_id,
+		.len = st->len - st->left,
+		.csum = st->csum,
+		.status = status,
+	};
+	iovec_t iov = { .base = &done, .len = sizeof(done) };
+	ipc_msg_t msg = {
+		.num_iov = 1, .iov = &iov, .num_handles = 0, .handles = NULL,
+	};
+
+	st->active = false;
+
+	/* sender waits for this reply, so its queue is empty */
+	rc = send_msg(st->chan, &msg);
+	if (rc < 0) {
+		TLOGI("failed (%d) to send bulk reply on chan (%d)\n",
+		      rc, st->chan);
+		return rc;
+	}
+	return NO_ERROR;
+}
+
+static int bulk_begin(bulk_chan_state_t *st, const uint8_t *buf, size_t len)
+{
+	struct bulk_ctrl req;
+
+	if (len != sizeof(req))
+		return ERR_BAD_LEN;
+
+	memcpy(&req, buf, sizeof(req));
+	st->xfer_id = req.xfer_id;
+	st->len = req.len;
+	st->left = req.len;
+	st->csum = 0;
+
+	if (req.cmd != BULK_CMD_BEGIN)
+		return bulk_send_done(st, ERR_INVALID_ARGS);
+	if (!req.len || req.len > BULK_MAX_XFER)
+		return bulk_send_done(st, ERR_TOO_BIG);
+
+	st->active = true;
+	return NO_ERROR;
+}
+
+static int bulk_handle_msg(bulk_chan_state_t *st)
+{
+	int rc;
+	ipc_msg_info_t inf;
+	iovec_t iov = { .base = bulk_buf, .len = sizeof(bulk_buf) };
+	ipc_msg_t msg = {
+		.num_iov = 1, .iov = &iov, .num_handles = 0, .handles = NULL,
+	};
+
+	for (;;) {
+		rc = get_msg(st->chan, &inf);
+		if (rc == ERR_NO_MSG)
+			return NO_ERROR;
+		if (rc != NO_ERROR) {
+			TLOGI("failed (%d) to get_msg for chan (%d)\n",
+			      rc, st->chan);
+			return rc;
+		}
+
+		rc = read_msg(st->chan, inf.id, 0, &msg);
+		put_msg(st->chan, inf.id);
+		if (rc < 0) {
+			TLOGI("failed (%d) to read_msg for chan (%d)\n",
+			      rc, st->chan);
+			return rc;
+		}
+
+		if (!st->active) {
+			rc = bulk_begin(st, bulk_buf, (size_t)rc);
+			if (rc != NO_ERROR)
+				return rc;
+			continue;
+		}
+
+		if ((uint32_t)rc > st->left) {
+			/* overrun: the transfer is broken, so is the channel */
+			return ERR_BAD_LEN;
+		}
+		st->csum = bulk_csum(st->csum, bulk_buf, (size_t)rc);
+		st->left -= (uint32_t)rc;
+
+		if (!st->left) {
+			rc = bulk_send_done(st, NO_ERROR);
+			if (rc != NO_ERROR)
+				return rc;
+		}
+	}
+}
+
+static void bulk_close_chan(bulk_chan_state_t *st)
+{
+	close(st->chan);
+	tipc_chan_state_free(st);
+}
+
+/*
+ * bulk service channel handler
+ */
+static void bulk_handle_chan(const uevent_t *ev)
+{
+	bulk_chan_state_t *st = containerof(ev->cookie, bulk_chan_state_t,
+	                                    handler);
+
+	if (ev->event & IPC_HANDLE_POLL_ERROR) {
+		TLOGI("error event (0x%x) for chan (%d)\n",
+		      ev->event, ev->handle);
+		goto close_it;
+	}
+
+	if (ev->event & IPC_HANDLE_POLL_MSG) {
+		if (bulk_handle_msg(st) != NO_ERROR)
+			goto close_it;
+	}
+
+	if (ev->event & IPC_HANDLE_POLL_HUP)
+		goto close_it;
+
+	return;
+
+close_it:
+	bulk_close_chan(st);
+}
+
+/*
+ *  bulk service port event handler
+ */
+static void bulk_handle_port(const uevent_t *ev)
+{
+	uuid_t peer_uuid;
+	bulk_chan_state_t *chan_st;
+	struct tipc_srv_state *state = tipc_get_srv_state(ev);
+
+	if (tipc_handle_port_errors(ev))
+		return;
+
+	if (ev->event & IPC_HANDLE_POLL_READY) {
+		handle_t chan;
+
+		int rc = accept(ev->handle, &peer_uuid);
+		if (rc < 0) {
+			TLOGI("failed (%d) to accept on port %d\n",
+			       rc, ev->handle);
+			return;
+		}
+		chan = (handle_t) rc;
+
+		chan_st = tipc_chan_state_alloc(state);
+		if (!chan_st) {
+			TLOGI("no channel state: closing chan %d\n", chan);
+			close(chan);
+			return;
+		}
+
+		/* init state */
+		chan_st->chan = chan;
+		chan_st->handler.proc = state->service->chan_handler;
+		chan_st->handler.priv = chan_st;
+
+		rc = set_cookie(chan, &chan_st->handler);
+		if (rc) {
+			TLOGI("failed (%d) to set_cookie on chan %d\n",
+			       rc, chan);
+			tipc_chan_state_free(chan_st);
+			close(chan);
+			return;
+		}
+	}
+}
+
 /***************************************************************************/
 
 /*
@@ -783,7 +1033,7 @@ static void uuid_handle_port(const uevent_t *ev)
 	iovec_t   iov;
 	uuid_t peer_uuid;
 
-	if (handle_port_errors(ev))
+	if (tipc_handle_port_errors(ev))
 		return;
 
 	if (ev->event & IPC_HANDLE_POLL_READY) {
@@ -818,41 +1068,16 @@ static void uuid_handle_port(const uevent_t *ev)
 
 /***************************************************************************/
 
+#ifdef WITH_MEMPROF
 /*
- *  Dispatch event
+ *  srv never exits: report peaks along with every dispatch stats report
  */
-static void dispatch_event(const uevent_t *ev)
+static void srv_memprof_report(struct tipc_srv_ctx *ctx)
 {
-	assert(ev);
-
-	if (ev->event == IPC_HANDLE_POLL_NONE) {
-		/* not really an event, do nothing */
-		TLOGI("got an empty event\n");
-		return;
-	}
-
-	if (ev->handle == INVALID_IPC_HANDLE) {
-		/* not a valid handle  */
-		TLOGI("got an event (0x%x) with invalid handle (%d)",
-		      ev->event, ev->handle);
-		return;
-	}
-
-	/* check if we have handler */
-	struct tipc_event_handler *handler = ev->cookie;
-	if (handler && handler->proc) {
-		/* invoke it */
-		handler->proc(ev);
-		return;
-	}
-
-	/* no handler? close it */
-	TLOGI("no handler for event (0x%x) with handle %d\n",
-	       ev->event, ev->handle);
-	close(ev->handle);
-
-	return;
+	MEMPROF_REPORT("ipc-unittest-srv" SRV_SHARD_SUFFIX,
+	               APP_MIN_HEAP_SIZE, APP_MIN_STACK_SIZE);
 }
+#endif
 
 /*
  *  Main entry point of service task
@@ -860,32 +1085,35 @@ static void dispatch_event(const uevent_t *ev)
 int main(void)
 {
 	int rc;
-	uevent_t event;
+
+	MEMPROF_INIT(APP_MIN_STACK_SIZE);
 
 	/* Initialize service */
-	rc = init_services();
+	TLOGI ("Init unittest services!!!\n");
+
+	/* publish all ports first: closer states wait for a connection */
+	_srv_ctx.lazy_port_state = true;
+#ifdef WITH_MEMPROF
+	_srv_ctx.report_hook = srv_memprof_report;
+#endif
+	rc = tipc_init_services(&_srv_ctx);
 	if (rc != NO_ERROR ) {
 		TLOGI("Failed (%d) to init service", rc);
-		kill_services();
+		tipc_kill_services(&_srv_ctx);
 		return -1;
 	}
 
+	/*
+	 * channel states come from a slab; port states are taken later,
+	 * those show up in the reports made while handling events
+	 */
+	MEMPROF_REPORT("ipc-unittest-srv" SRV_SHARD_SUFFIX,
+	               APP_MIN_HEAP_SIZE, APP_MIN_STACK_SIZE);
+
 	/* handle events */
-	while (!stopped) {
-		event.handle = INVALID_IPC_HANDLE;
-		event.event  = 0;
-		event.cookie = NULL;
-		rc = wait_any(&event, -1);
-		if (rc < 0) {
-			TLOGI("wait_any failed (%d)", rc);
-			continue;
-		}
-		if (rc == NO_ERROR) { /* got an event */
-			dispatch_event(&event);
-		}
-	}
+	rc = tipc_run_services(&_srv_ctx);
 
-	kill_services();
-	return 0;
+	TLOGI ("Terminating unittest services\n");
+	tipc_kill_services(&_srv_ctx);
+	return rc;
 }
-
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <err.h>
+#include <string.h>
+#include <trusty_std.h>
+
+#include <lib/hwkey_ext/hwkey_async.h>
+
+#include "hwkey_priv.h"
+
+/* tickets are op_ids folded into a non-negative long */
+#define TICKET_MASK  0x7fffffffU
+
+void hwkey_async_init(struct hwkey_async *ha, hwkey_session_t session)
+{
+	memset(ha, 0, sizeof(*ha));
+	ha->session = session;
+}
+
+static struct hwkey_async_op *find_op(struct hwkey_async *ha,
+				      const struct hwkey_derive_req *req)
+{
+	for (uint i = 0; i < countof(ha->ops); i++) {
+		if (ha->ops[i].req == req)
+			return &ha->ops[i];
+	}
+	return NULL;
+}
+
+static struct hwkey_derive_req *async_match(void *ctx, uint32_t op_id)
+{
+	struct hwkey_async *ha = ctx;
+
+	for (uint i = 0; i < countof(ha->ops); i++) {
+		struct hwkey_async_op *op = &ha->ops[i];
+
+		if (op->req && op->sent && op->op_id == op_id)
+			return op->req;
+	}
+	return NULL;
+}
+
+/* free slot, then tell the owner: it may want to reuse the slot */
+static void complete_op(struct hwkey_async *ha, struct hwkey_async_op *op)
+{
+	struct hwkey_derive_req *req = op->req;
+	hwkey_async_done_t done = op->done;
+	void *priv = op->priv;
+
+	memset(op, 0, sizeof(*op));
+	ha->busy--;
+
+	if (done)
+		done(ha, req, priv);
+}
+
+static void fail_all(struct hwkey_async *ha, long rc)
+{
+	for (uint i = 0; i < countof(ha->ops); i++) {
+		struct hwkey_async_op *op = &ha->ops[i];
+
+		if (op->req) {
+			op->req->rc = rc;
+			complete_op(ha, op);
+		}
+	}
+}
+
+/*
+ *  Send whatever is queued until the server stops taking requests
+ */
+static uint flush(struct hwkey_async *ha)
+{
+	uint cnt = 0;
+
+	for (uint i = 0; i < countof(ha->ops) && !ha->blocked; i++) {
+		struct hwkey_async_op *op = &ha->ops[i];
+
+		if (!op->req || op->sent)
+			continue;
+
+		long rc = hwkey_send_derive(ha->session, op->req, op->op_id);
+		if (rc == ERR_NOT_ENOUGH_BUFFER) {
+			/* resent on SEND_UNBLOCKED or next reply */
+			ha->blocked = true;
+			break;
+		}
+		if (rc < 0) {
+			op->req->rc = rc;
+			complete_op(ha, op);
+			cnt++;
+			continue;
+		}
+		op->sent = true;
+	}
+	return cnt;
+}
+
+long hwkey_derive_submit(struct hwkey_async *ha, struct hwkey_derive_req *req,
+			 hwkey_async_done_t done, void *priv)
+{
+	struct hwkey_async_op *op;
+	long rc;
+
+	rc = hwkey_check_derive(req);
+	if (rc < 0)
+		return rc;
+
+	op = find_op(ha, NULL);
+	if (!op)
+		return ERR_NOT_ENOUGH_BUFFER;
+
+	op->req = req;
+	op->op_id = hwkey_alloc_op_ids(1);
+	op->sent = false;
+	op->done = done;
+	op->priv = priv;
+	req->rc = HWKEY_DERIVE_PENDING;
+	ha->busy++;
+
+	/* a send failure completes the request, the ticket is still good */
+	rc = op->op_id & TICKET_MASK;
+	flush(ha);
+	return rc;
+}
+
+long hwkey_async_handle_event(struct hwkey_async *ha, const uevent_t *ev)
+{
+	struct hwkey_derive_req *req;
+	long cnt = 0;
+	long rc;
+
+	if (ev->event & (IPC_HANDLE_POLL_HUP | IPC_HANDLE_POLL_ERROR)) {
+		fail_all(ha, ERR_CHANNEL_CLOSED);
+		return ERR_CHANNEL_CLOSED;
+	}
+
+	if (ev->event & IPC_HANDLE_POLL_SEND_UNBLOCKED)
+		ha->blocked = false;
+
+	if (ev->event & IPC_HANDLE_POLL_MSG) {
+		for (;;) {
+			rc = hwkey_recv_derive(ha->session, async_match, ha,
+					       &req);
+			if (rc == ERR_NO_MSG)
+				break;
+			if (rc < 0) {
+				fail_all(ha, rc);
+				return rc;
+			}
+			/* server consumed at least one request */
+			ha->blocked = false;
+			if (req) {
+				complete_op(ha, find_op(ha, req));
+				cnt++;
+			}
+		}
+	}
+
+	return cnt + flush(ha);
+}
+
+static bool ticket_pending(struct hwkey_async *ha, long ticket)
+{
+	for (uint i = 0; i < countof(ha->ops); i++) {
+		struct hwkey_async_op *op = &ha->ops[i];
+
+		if (op->req && (long)(op->op_id & TICKET_MASK) == ticket)
+			return true;
+	}
+	return false;
+}
+
+long hwkey_async_wait(struct hwkey_async *ha, long ticket, uint32_t timeout)
+{
+	uevent_t ev;
+	long rc;
+
+	while (ticket_pending(ha, ticket)) {
+		rc = wait(ha->session, &ev, timeout);
+		if (rc < 0)
+			return rc;
+
+		rc = hwkey_async_handle_event(ha, &ev);
+		if (rc < 0)
+			return rc;
+	}
+	return NO_ERROR;
+}
+
+void hwkey_async_cancel(struct hwkey_async *ha)
+{
+	/* late replies no longer match anything and are dropped */
+	fail_all(ha, ERR_CANCELLED);
+	ha->blocked = false;
+}
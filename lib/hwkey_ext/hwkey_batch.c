@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <err.h>
+#include <string.h>
+#include <trusty_std.h>
+
+#include <interface/hwkey/hwkey.h>
+#include <lib/hwkey_ext/hwkey_batch.h>
+
+#include "hwkey_priv.h"
+
+/* op_ids of batch and async requests, distinct runs never reuse a live id */
+static uint32_t _op_id = 0x80000000;
+
+struct batch_ctx {
+	struct hwkey_derive_req *reqs;
+	uint cnt;
+	uint32_t base_id;
+};
+
+uint32_t hwkey_alloc_op_ids(uint cnt)
+{
+	uint32_t base_id = _op_id;
+
+	_op_id += cnt;
+	return base_id;
+}
+
+long hwkey_err_to_err(uint32_t status)
+{
+	switch (status) {
+	case HWKEY_NO_ERROR:
+		return NO_ERROR;
+	case HWKEY_ERR_NOT_VALID:
+		return ERR_NOT_VALID;
+	case HWKEY_ERR_BAD_LEN:
+		return ERR_BAD_LEN;
+	case HWKEY_ERR_NOT_IMPLEMENTED:
+		return ERR_NOT_IMPLEMENTED;
+	case HWKEY_ERR_NOT_FOUND:
+		return ERR_NOT_FOUND;
+	default:
+		return ERR_GENERIC;
+	}
+}
+
+long hwkey_check_derive(const struct hwkey_derive_req *req)
+{
+	if (!req->src || !req->dest || !req->size)
+		return ERR_NOT_VALID;
+	if (req->size > HWKEY_DERIVE_MAX_PAYLOAD)
+		return ERR_TOO_BIG;
+	return NO_ERROR;
+}
+
+long hwkey_send_derive(hwkey_session_t session,
+		       const struct hwkey_derive_req *req, uint32_t op_id)
+{
+	struct hwkey_msg hdr = {
+		.cmd = HWKEY_DERIVE,
+		.op_id = op_id,
+		.arg1 = req->kdf_version,
+	};
+	iovec_t iov[2] = {
+		{ .base = &hdr, .len = sizeof(hdr) },
+		{ .base = (void *)req->src, .len = req->size },
+	};
+	ipc_msg_t msg = {
+		.num_iov = countof(iov),
+		.iov = iov,
+	};
+
+	long rc = send_msg(session, &msg);
+	if (rc < 0)
+		return rc;
+	if ((size_t)rc != sizeof(hdr) + req->size)
+		return ERR_IO;
+	return NO_ERROR;
+}
+
+long hwkey_recv_derive(hwkey_session_t session, hwkey_match_fn_t match,
+		       void *ctx, struct hwkey_derive_req **done)
+{
+	struct hwkey_msg hdr;
+	ipc_msg_info_t mi;
+	iovec_t iov = { .base = &hdr, .len = sizeof(hdr) };
+	ipc_msg_t msg = { .num_iov = 1, .iov = &iov };
+	struct hwkey_derive_req *req;
+	long rc;
+
+	*done = NULL;
+	rc = get_msg(session, &mi);
+	if (rc < 0)
+		return rc;
+
+	rc = read_msg(session, mi.id, 0, &msg);
+	if (rc < 0)
+		goto done;
+	if ((size_t)rc < sizeof(hdr) ||
+	    hdr.cmd != (HWKEY_DERIVE | HWKEY_RESP_BIT)) {
+		rc = NO_ERROR;   /* not ours */
+		goto done;
+	}
+
+	rc = NO_ERROR;
+	req = match(ctx, hdr.op_id);
+	if (!req)
+		goto done;
+
+	req->rc = hwkey_err_to_err(hdr.status);
+	if (req->rc == NO_ERROR) {
+		if (mi.len != sizeof(hdr) + req->size) {
+			req->rc = ERR_BAD_LEN;
+		} else {
+			iov.base = req->dest;
+			iov.len = req->size;
+			rc = read_msg(session, mi.id, sizeof(hdr), &msg);
+			if (rc < 0 || (size_t)rc != req->size)
+				req->rc = rc < 0 ? rc : ERR_IO;
+			else
+				req->kdf_version = hdr.arg1;
+			rc = NO_ERROR;
+		}
+	}
+	*done = req;
+
+done:
+	put_msg(session, mi.id);
+	return rc;
+}
+
+static struct hwkey_derive_req *batch_match(void *ctx, uint32_t op_id)
+{
+	struct batch_ctx *b = ctx;
+	struct hwkey_derive_req *req;
+
+	if (op_id - b->base_id >= b->cnt)
+		return NULL;
+
+	req = &b->reqs[op_id - b->base_id];
+	return (req->rc == HWKEY_DERIVE_PENDING) ? req : NULL;
+}
+
+long hwkey_derive_batch(hwkey_session_t session,
+			struct hwkey_derive_req *reqs, uint cnt,
+			uint32_t timeout)
+{
+	uint32_t base_id = hwkey_alloc_op_ids(cnt);
+	struct batch_ctx ctx = { reqs, cnt, base_id };
+	struct hwkey_derive_req *done;
+	uint next = 0;
+	uint inflight = 0;
+	bool blocked = false;
+	long rc = NO_ERROR;
+	uevent_t ev;
+
+	for (uint i = 0; i < cnt; i++) {
+		long err = hwkey_check_derive(&reqs[i]);
+
+		reqs[i].rc = err ? err : HWKEY_DERIVE_PENDING;
+	}
+
+	for (;;) {
+		/* fill the pipe */
+		while (!blocked && next < cnt &&
+		       inflight < HWKEY_BATCH_MAX_INFLIGHT) {
+			struct hwkey_derive_req *req = &reqs[next];
+
+			if (req->rc != HWKEY_DERIVE_PENDING) {
+				next++;
+				continue;
+			}
+
+			rc = hwkey_send_derive(session, req, base_id + next);
+			if (rc == ERR_NOT_ENOUGH_BUFFER) {
+				/* peer queue is full: retry once it drains */
+				blocked = true;
+				rc = NO_ERROR;
+				break;
+			}
+			if (rc < 0)
+				goto err;
+			inflight++;
+			next++;
+		}
+
+		/* count only requests we are still waiting for */
+		inflight = 0;
+		for (uint i = 0; i < next; i++) {
+			if (reqs[i].rc == HWKEY_DERIVE_PENDING)
+				inflight++;
+		}
+		if (!inflight && next == cnt)
+			break;
+
+		rc = wait(session, &ev, timeout);
+		if (rc < 0)
+			goto err;
+
+		if (ev.event & (IPC_HANDLE_POLL_HUP | IPC_HANDLE_POLL_ERROR)) {
+			rc = ERR_CHANNEL_CLOSED;
+			goto err;
+		}
+		if (ev.event & IPC_HANDLE_POLL_SEND_UNBLOCKED)
+			blocked = false;
+		if (ev.event & IPC_HANDLE_POLL_MSG) {
+			rc = hwkey_recv_derive(session, batch_match, &ctx,
+					       &done);
+			if (rc < 0)
+				goto err;
+			/* server consumed at least one request */
+			blocked = false;
+		}
+	}
+	return NO_ERROR;
+
+err:
+	for (uint i = 0; i < cnt; i++) {
+		if (reqs[i].rc == HWKEY_DERIVE_PENDING)
+			reqs[i].rc = rc;
+	}
+	return rc;
+}
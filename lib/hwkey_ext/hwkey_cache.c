@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <err.h>
+#include <stdbool.h>
+#include <string.h>
+#include <trusty_std.h>
+
+#include <lib/hwkey_ext/hwkey_cache.h>
+
+struct hwkey_cache_entry {
+	bool used;
+	hwkey_session_t session;
+	uint32_t req_version;     /* version asked for, may be BEST */
+	uint32_t kdf_version;     /* version actually used by server */
+	uint32_t size;
+	uint32_t last_use;
+	uint8_t src[HWKEY_CACHE_MAX_KEY_SIZE];
+	uint8_t key[HWKEY_CACHE_MAX_KEY_SIZE];
+};
+
+/* sessions opened with hwkey_cache_open() */
+struct hwkey_cache_session {
+	bool used;
+	hwkey_session_t session;
+};
+
+static struct hwkey_cache_session _sessions[HWKEY_CACHE_MAX_SESSIONS];
+static struct hwkey_cache_entry _entries[HWKEY_CACHE_MAX_ENTRIES];
+static struct hwkey_cache_stats _stats;
+static uint32_t _clock;
+
+/* memset that compiler is not allowed to drop */
+static void wipe(void *buf, size_t len)
+{
+	volatile uint8_t *p = buf;
+
+	while (len--)
+		*p++ = 0;
+}
+
+static struct hwkey_cache_session *find_session(hwkey_session_t session)
+{
+	for (uint i = 0; i < countof(_sessions); i++) {
+		if (_sessions[i].used && _sessions[i].session == session)
+			return &_sessions[i];
+	}
+	return NULL;
+}
+
+static struct hwkey_cache_session *alloc_session(void)
+{
+	for (uint i = 0; i < countof(_sessions); i++) {
+		if (!_sessions[i].used)
+			return &_sessions[i];
+	}
+	return NULL;
+}
+
+static void drop_entry(struct hwkey_cache_entry *e)
+{
+	_stats.entries--;
+	_stats.bytes -= e->size;
+	wipe(e, sizeof(*e));
+}
+
+static struct hwkey_cache_entry *lookup(hwkey_session_t session,
+					uint32_t kdf_version,
+					const uint8_t *src, uint32_t size)
+{
+	for (uint i = 0; i < countof(_entries); i++) {
+		struct hwkey_cache_entry *e = &_entries[i];
+
+		if (!e->used || e->session != session || e->size != size)
+			continue;
+		if (kdf_version != e->req_version &&
+		    kdf_version != e->kdf_version)
+			continue;
+		if (memcmp(e->src, src, size) == 0)
+			return e;
+	}
+	return NULL;
+}
+
+/*
+ * Evict least recently used entries until there is a free slot and
+ * room for size more bytes of key material
+ */
+static struct hwkey_cache_entry *alloc_entry(uint32_t size)
+{
+	struct hwkey_cache_entry *free_e;
+
+	for (;;) {
+		struct hwkey_cache_entry *lru = NULL;
+
+		free_e = NULL;
+		for (uint i = 0; i < countof(_entries); i++) {
+			struct hwkey_cache_entry *e = &_entries[i];
+
+			if (!e->used) {
+				if (!free_e)
+					free_e = e;
+			} else if (!lru ||
+				   (int32_t)(e->last_use - lru->last_use) < 0) {
+				lru = e;
+			}
+		}
+
+		if (free_e && _stats.bytes + size <= HWKEY_CACHE_MAX_BYTES)
+			return free_e;
+
+		if (!lru)
+			return NULL;
+
+		drop_entry(lru);
+		_stats.evictions++;
+	}
+}
+
+long hwkey_cache_open(void)
+{
+	struct hwkey_cache_session *s = alloc_session();
+	long rc;
+
+	if (!s)
+		return ERR_NO_RESOURCES;
+
+	rc = hwkey_open();
+	if (rc < 0)
+		return rc;
+
+	s->used = true;
+	s->session = (hwkey_session_t)rc;
+	return rc;
+}
+
+long hwkey_cache_derive(hwkey_session_t session, uint32_t *kdf_version,
+			const uint8_t *src, uint8_t *dest, uint32_t buf_size)
+{
+	struct hwkey_cache_entry *e;
+	uint32_t req_version;
+	long rc;
+
+	if (!find_session(session))
+		return ERR_NOT_FOUND;
+
+	if (!kdf_version || !src || !dest || !buf_size ||
+	    buf_size > HWKEY_CACHE_MAX_KEY_SIZE) {
+		/* not cacheable: let hwkey_derive sort it out */
+		return hwkey_derive(session, kdf_version, src, dest, buf_size);
+	}
+
+	req_version = *kdf_version;
+	e = lookup(session, req_version, src, buf_size);
+	if (e) {
+		_stats.hits++;
+		e->last_use = ++_clock;
+		*kdf_version = e->kdf_version;
+		memcpy(dest, e->key, buf_size);
+		return NO_ERROR;
+	}
+
+	_stats.misses++;
+	rc = hwkey_derive(session, kdf_version, src, dest, buf_size);
+	if (rc != NO_ERROR)
+		return rc;
+
+	e = alloc_entry(buf_size);
+	if (!e)
+		return rc;
+
+	e->used = true;
+	e->session = session;
+	e->req_version = req_version;
+	e->kdf_version = *kdf_version;
+	e->size = buf_size;
+	e->last_use = ++_clock;
+	memcpy(e->src, src, buf_size);
+	memcpy(e->key, dest, buf_size);
+	_stats.entries++;
+	_stats.bytes += buf_size;
+
+	return rc;
+}
+
+void hwkey_cache_flush(hwkey_session_t session)
+{
+	for (uint i = 0; i < countof(_entries); i++) {
+		if (_entries[i].used && _entries[i].session == session)
+			drop_entry(&_entries[i]);
+	}
+}
+
+void hwkey_cache_close(hwkey_session_t session)
+{
+	struct hwkey_cache_session *s = find_session(session);
+
+	hwkey_cache_flush(session);
+	if (s)
+		s->used = false;
+	hwkey_close(session);
+}
+
+void hwkey_cache_get_stats(struct hwkey_cache_stats *stats)
+{
+	*stats = _stats;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <trusty_std.h>
+
+#include <interface/hwkey/hwkey.h>
+#include <lib/hwkey_ext/hwkey_batch.h>
+
+/*
+ * Derive request messages shared by the batch and async clients.
+ */
+#define HWKEY_DERIVE_MAX_PAYLOAD  (HWKEY_MAX_MSG_SIZE - sizeof(struct hwkey_msg))
+
+/* returns pending request with op_id, NULL if there is none */
+typedef struct hwkey_derive_req *(*hwkey_match_fn_t)(void *ctx,
+						     uint32_t op_id);
+
+/* reserve cnt consecutive op_ids, distinct from any live ones */
+uint32_t hwkey_alloc_op_ids(uint cnt);
+
+long hwkey_err_to_err(uint32_t status);
+
+/* checks src, dest and size, returns NO_ERROR or error for req->rc */
+long hwkey_check_derive(const struct hwkey_derive_req *req);
+
+long hwkey_send_derive(hwkey_session_t session,
+		       const struct hwkey_derive_req *req, uint32_t op_id);
+
+/*
+ * Read one reply and complete the request match() returns for it,
+ * which is also stored in *done (NULL for replies that are not ours,
+ * which are dropped). Returns ERR_NO_MSG if there is nothing to read.
+ */
+long hwkey_recv_derive(hwkey_session_t session, hwkey_match_fn_t match,
+		       void *ctx, struct hwkey_derive_req **done);
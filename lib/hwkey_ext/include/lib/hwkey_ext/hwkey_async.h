@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <trusty_std.h>
+#include <lib/hwkey/hwkey.h>
+#include <lib/hwkey_ext/hwkey_batch.h>
+
+/*
+ * Non-blocking key derivation.
+ *
+ * hwkey_derive_submit() queues a derive request on the session channel
+ * and returns a ticket right away. The request's rc stays
+ * HWKEY_DERIVE_PENDING until its reply has been read, so the caller
+ * can do other work (storage I/O, other IPC) while the server runs the
+ * KDF. Up to HWKEY_ASYNC_MAX_INFLIGHT requests can be outstanding.
+ *
+ * Replies are picked up by hwkey_async_handle_event(), fed with events
+ * for the session handle from the app's own wait_any() loop. The
+ * library does not set a cookie on the session: the app attaches
+ * whatever its loop needs to recognize it. hwkey_async_wait() runs the
+ * same processing on the session alone until a given ticket completes.
+ *
+ * req, src and dest must stay valid until the request completes. The
+ * optional callback runs once per request, after its result is in
+ * req->rc and its slot has been freed, so it can submit more work.
+ */
+#define HWKEY_ASYNC_MAX_INFLIGHT   8
+
+struct hwkey_async;
+
+typedef void (*hwkey_async_done_t)(struct hwkey_async *ha,
+				   struct hwkey_derive_req *req, void *priv);
+
+struct hwkey_async_op {
+	struct hwkey_derive_req *req;   /* NULL - slot is free */
+	uint32_t op_id;
+	bool sent;
+	hwkey_async_done_t done;
+	void *priv;
+};
+
+struct hwkey_async {
+	hwkey_session_t session;
+	bool blocked;                   /* server queue full */
+	uint busy;                      /* slots in use */
+	struct hwkey_async_op ops[HWKEY_ASYNC_MAX_INFLIGHT];
+};
+
+void hwkey_async_init(struct hwkey_async *ha, hwkey_session_t session);
+
+/*
+ * Returns non-negative ticket, ERR_NOT_VALID or ERR_TOO_BIG for bad
+ * requests, ERR_NOT_ENOUGH_BUFFER if all slots are in use.
+ */
+long hwkey_derive_submit(struct hwkey_async *ha, struct hwkey_derive_req *req,
+			 hwkey_async_done_t done, void *priv);
+
+/*
+ * Process one event for the session handle. Returns number of requests
+ * completed or negative error if the session failed, in which case all
+ * outstanding requests have completed with that error.
+ */
+long hwkey_async_handle_event(struct hwkey_async *ha, const uevent_t *ev);
+
+/*
+ * Handle session events until ticket completes. Returns NO_ERROR once
+ * it has (also for tickets that completed earlier), ERR_TIMED_OUT or a
+ * session error.
+ */
+long hwkey_async_wait(struct hwkey_async *ha, long ticket, uint32_t timeout);
+
+/* complete all outstanding requests with ERR_CANCELLED */
+void hwkey_async_cancel(struct hwkey_async *ha);
+
+static inline uint hwkey_async_pending(const struct hwkey_async *ha)
+{
+	return ha->busy;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <trusty_std.h>
+#include <lib/hwkey/hwkey.h>
+
+/*
+ * Vectored key derivation.
+ *
+ * The hwkey protocol carries one derivation per message, so instead of
+ * a round trip per key hwkey_derive_batch() keeps up to
+ * HWKEY_BATCH_MAX_INFLIGHT requests queued on the session channel and
+ * collects the replies as they come back, matching them by op_id.
+ */
+#define HWKEY_BATCH_MAX_INFLIGHT   8
+#define HWKEY_DERIVE_PENDING       1   /* rc of request waiting for reply */
+
+struct hwkey_derive_req {
+	uint32_t kdf_version;     /* in: requested, out: used by server */
+	const uint8_t *src;
+	uint8_t *dest;
+	uint32_t size;            /* size of both src and dest */
+	long rc;                  /* out: per request result */
+};
+
+/*
+ * Derive cnt keys on session, waiting at most timeout ms for each event
+ * from the server.
+ *
+ * Returns NO_ERROR if all requests went through the channel, in which
+ * case the result of every derivation (same as hwkey_derive() would
+ * return for it) is in its rc field. A negative return means the
+ * session itself failed or the server went quiet for longer than
+ * timeout (ERR_TIMED_OUT); requests that did not complete have rc set
+ * to that error. Late replies to them are dropped by later calls.
+ */
+long hwkey_derive_batch(hwkey_session_t session,
+			struct hwkey_derive_req *reqs, uint cnt,
+			uint32_t timeout);
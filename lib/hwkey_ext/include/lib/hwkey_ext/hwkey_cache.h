@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <lib/hwkey/hwkey.h>
+
+/*
+ * Derived key cache.
+ *
+ * hwkey_derive() is deterministic for given kdf version and source data,
+ * so hwkey_cache_derive() keeps the results in a small table and answers
+ * repeated requests without a round trip to the hwkey server. Entries
+ * belong to the session they were derived on. Total amount of cached key
+ * material is capped by HWKEY_CACHE_MAX_BYTES; least recently used
+ * entries are evicted (and wiped) to make room for new ones.
+ *
+ * The cache is opt-in per session: only sessions opened with
+ * hwkey_cache_open() are served, any other session gets ERR_NOT_FOUND.
+ * Such sessions must be closed with hwkey_cache_close(), which wipes all
+ * of their entries before closing the session. Closing them with plain
+ * hwkey_close() would leave entries behind for whatever session reuses
+ * the handle number next.
+ */
+#define HWKEY_CACHE_MAX_SESSIONS    4
+#define HWKEY_CACHE_MAX_ENTRIES    16
+#define HWKEY_CACHE_MAX_KEY_SIZE   64    /* larger keys are never cached */
+#define HWKEY_CACHE_MAX_BYTES     512    /* sum of cached key sizes */
+
+struct hwkey_cache_stats {
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t evictions;
+	uint32_t entries;
+	uint32_t bytes;
+};
+
+/* same as hwkey_open(), and registers the new session with the cache */
+long hwkey_cache_open(void);
+
+/* same as hwkey_derive() but served from cache when possible */
+long hwkey_cache_derive(hwkey_session_t session, uint32_t *kdf_version,
+			const uint8_t *src, uint8_t *dest, uint32_t buf_size);
+
+/* wipe all entries of session, session stays open */
+void hwkey_cache_flush(hwkey_session_t session);
+
+/* wipe all entries of session and close it */
+void hwkey_cache_close(hwkey_session_t session);
+
+void hwkey_cache_get_stats(struct hwkey_cache_stats *stats);
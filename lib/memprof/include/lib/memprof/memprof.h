@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Heap and stack high water marks for sizing app manifests.
+ *
+ * Everything here is compiled in only with WITH_MEMPROF. Without it the
+ * MEMPROF_* macros expand to nothing and allocations are left alone.
+ *
+ * Stack: MEMPROF_INIT(stack_size), first thing in main(), paints the
+ * unused part of the stack with a known pattern. The report scans for
+ * the deepest word that no longer holds it. The stack is taken to end
+ * at the first page boundary at or above main()'s frame, so its bottom
+ * is stack_size below that boundary, not below main(). The part above
+ * main() and a MEMPROF_STACK_SLACK margin at the bottom are never
+ * painted.
+ *
+ * Heap: files that include this header after the libc headers get
+ * malloc, calloc, memalign and free redirected to counting wrappers,
+ * which track bytes requested by live allocations and their peak.
+ * Allocator overhead and allocations made inside libc are not seen.
+ *
+ * MEMPROF_REPORT(app, heap_size, stack_size) prints the peaks next to
+ * the configured sizes as PERF lines, plus a line with page rounded
+ * manifest values that leave MEMPROF_MARGIN_PCT percent headroom.
+ */
+#define MEMPROF_PAINT          0xa5a5a5a5U
+#define MEMPROF_STACK_SLACK    512   /* bottom of stack left unpainted */
+#define MEMPROF_HEAP_OVERHEAD  1024  /* allowance for allocator metadata */
+#define MEMPROF_MARGIN_PCT     25
+#define MEMPROF_PAGE_SIZE      4096
+
+struct memprof_stats {
+	size_t heap_cur;       /* bytes requested by live allocations */
+	size_t heap_peak;
+	uint64_t allocs;
+	uint64_t frees;
+	size_t stack_peak;     /* deepest stack use seen below main() */
+	size_t stack_painted;  /* bytes painted, 0 - not initialized */
+};
+
+#ifdef WITH_MEMPROF
+
+void memprof_stack_paint(void *top, size_t stack_size);
+void memprof_get_stats(struct memprof_stats *stats);
+void memprof_report(const char *app, size_t heap_size, size_t stack_size);
+
+void *memprof_malloc(size_t size);
+void *memprof_calloc(size_t cnt, size_t size);
+void *memprof_memalign(size_t align, size_t size);
+void  memprof_free(void *ptr);
+
+#define MEMPROF_INIT(stack_size)                                 \
+	do {                                                     \
+		volatile uint32_t _memprof_top;                  \
+		memprof_stack_paint((void *)&_memprof_top,       \
+		                    (stack_size));               \
+	} while (0)
+
+#define MEMPROF_REPORT(app, heap_size, stack_size) \
+	memprof_report((app), (heap_size), (stack_size))
+
+#ifndef MEMPROF_NO_WRAP
+#define malloc(size)            memprof_malloc(size)
+#define calloc(cnt, size)       memprof_calloc(cnt, size)
+#define memalign(align, size)   memprof_memalign(align, size)
+#define free(ptr)               memprof_free(ptr)
+#endif
+
+#else
+
+#define MEMPROF_INIT(stack_size)                     do { } while (0)
+#define MEMPROF_REPORT(app, heap_size, stack_size)   do { } while (0)
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <trusty_std.h>
+
+/* this file calls the real allocator */
+#define MEMPROF_NO_WRAP
+
+#include <lib/memprof/memprof.h>
+#include <lib/perf/perf_stats.h>
+
+#ifdef WITH_MEMPROF
+
+/* kept right below every pointer handed out */
+struct memprof_hdr {
+	void *raw;
+	size_t size;
+};
+
+static struct memprof_stats _stats;
+static uintptr_t _stack_top;
+static volatile uint32_t *_stack_lo;
+static volatile uint32_t *_stack_hi;
+
+/****************************************************************************/
+
+__attribute__((noinline))
+void memprof_stack_paint(void *top, size_t stack_size)
+{
+	uintptr_t here = (uintptr_t)__builtin_frame_address(0);
+	/* stack ends at a page boundary, somewhere above top */
+	uintptr_t top_page = ((uintptr_t)top + MEMPROF_PAGE_SIZE - 1) &
+	                     ~(uintptr_t)(MEMPROF_PAGE_SIZE - 1);
+	uintptr_t lo = (top_page - stack_size + MEMPROF_STACK_SLACK + 3) &
+	               ~(uintptr_t)3;
+	uintptr_t hi = (here - 256) & ~(uintptr_t)3;  /* clear of this frame */
+
+	if (stack_size <= MEMPROF_STACK_SLACK || top_page < stack_size ||
+	    hi <= lo)
+		return;
+
+	_stack_top = (uintptr_t)top;
+	_stack_lo = (volatile uint32_t *)lo;
+	_stack_hi = (volatile uint32_t *)hi;
+
+	for (volatile uint32_t *p = _stack_lo; p < _stack_hi; p++)
+		*p = MEMPROF_PAINT;
+
+	_stats.stack_painted = hi - lo;
+}
+
+static size_t memprof_stack_peak(void)
+{
+	volatile uint32_t *p = _stack_lo;
+
+	if (!_stats.stack_painted)
+		return 0;
+
+	/* deepest word that has been overwritten */
+	while (p < _stack_hi && *p == MEMPROF_PAINT)
+		p++;
+
+	/* nothing overwritten: depth at paint time is the peak */
+	return _stack_top - (uintptr_t)p;
+}
+
+/****************************************************************************/
+
+void *memprof_memalign(size_t align, size_t size)
+{
+	struct memprof_hdr *hdr;
+	size_t off;
+	uint8_t *raw;
+
+	if (align < sizeof(void *))
+		align = sizeof(void *);
+
+	/* room for header, keeping returned pointer aligned */
+	off = (sizeof(*hdr) + align - 1) & ~(align - 1);
+	raw = memalign(align, off + size);
+	if (!raw)
+		return NULL;
+
+	hdr = (struct memprof_hdr *)(raw + off) - 1;
+	hdr->raw = raw;
+	hdr->size = size;
+
+	_stats.allocs++;
+	_stats.heap_cur += size;
+	if (_stats.heap_cur > _stats.heap_peak)
+		_stats.heap_peak = _stats.heap_cur;
+
+	return raw + off;
+}
+
+void *memprof_malloc(size_t size)
+{
+	return memprof_memalign(2 * sizeof(void *), size);
+}
+
+void *memprof_calloc(size_t cnt, size_t size)
+{
+	void *ptr;
+
+	if (size && cnt > SIZE_MAX / size)
+		return NULL;
+
+	ptr = memprof_malloc(cnt * size);
+	if (ptr)
+		memset(ptr, 0, cnt * size);
+	return ptr;
+}
+
+void memprof_free(void *ptr)
+{
+	struct memprof_hdr *hdr;
+
+	if (!ptr)
+		return;
+
+	hdr = (struct memprof_hdr *)ptr - 1;
+	_stats.frees++;
+	_stats.heap_cur -= hdr->size;
+	free(hdr->raw);
+}
+
+/****************************************************************************/
+
+void memprof_get_stats(struct memprof_stats *stats)
+{
+	*stats = _stats;
+	stats->stack_peak = memprof_stack_peak();
+}
+
+static size_t memprof_suggest(size_t peak)
+{
+	size_t sz = peak + peak * MEMPROF_MARGIN_PCT / 100;
+
+	sz = (sz + MEMPROF_PAGE_SIZE - 1) / MEMPROF_PAGE_SIZE;
+	return sz ? sz : 1;
+}
+
+void memprof_report(const char *app, size_t heap_size, size_t stack_size)
+{
+	struct memprof_stats st;
+
+	memprof_get_stats(&st);
+
+	perf_print_value("mem", app, "heap_peak", st.heap_peak, "bytes");
+	perf_print_value("mem", app, "heap_live", st.heap_cur, "bytes");
+	perf_print_value("mem", app, "heap_allocs", st.allocs, "calls");
+	perf_print_value("mem", app, "heap_config", heap_size, "bytes");
+	perf_print_value("mem", app, "stack_peak", st.stack_peak, "bytes");
+	perf_print_value("mem", app, "stack_config", stack_size, "bytes");
+
+	const char *note = "";
+	if (!st.stack_painted)
+		note = " (stack not painted)";
+	else if (st.stack_peak + MEMPROF_STACK_SLACK >= stack_size)
+		note = " (stack used up to unpainted bottom: too small)";
+
+	/* stack peak does not include frames above main(): use the slack */
+	fprintf(stderr, "MEMPROF %s suggest "
+	        "TRUSTY_APP_CONFIG_MIN_HEAP_SIZE(%zu * 4096) "
+	        "TRUSTY_APP_CONFIG_MIN_STACK_SIZE(%zu * 4096)%s\n", app,
+	        memprof_suggest(st.heap_peak + MEMPROF_HEAP_OVERHEAD),
+	        memprof_suggest(st.stack_peak + MEMPROF_STACK_SLACK), note);
+}
+
+#endif /* WITH_MEMPROF */
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <trusty_std.h>
+
+/*
+ * Timing and statistics helpers shared by sample apps and benchmarks.
+ *
+ * perf_now_ns() reads the monotonic clock. perf_ticks() reads the
+ * cheapest counter available: with WITH_PERF_CNTVCT on arm64 that is
+ * the virtual counter (EL0 access has to be enabled by the kernel),
+ * otherwise it is the same as perf_now_ns(). Use perf_ticks_to_ns() for
+ * differences of perf_ticks() values.
+ *
+ * struct perf_stats is an online accumulator: count, sum, min, max and
+ * a histogram good enough for percentiles. Values below PERF_SUB_CNT get
+ * a bucket each, above that every power of two range is split into
+ * PERF_SUB_CNT linear sub-buckets. Percentiles report the middle of
+ * the bucket, which is within 1/(2 * PERF_SUB_CNT) of the real value.
+ * Values of 2^PERF_MAX_BITS and above are counted in the last bucket.
+ * Units are up to the caller. A zero initialized struct perf_stats is
+ * empty. With 16 sub-buckets percentiles are within ~3%, and the struct
+ * is over 2 KB: keep instances static, not on the stack.
+ *
+ * Results are printed as single lines of the form
+ *
+ *   PERF <suite> <name> cnt=.. min=.. mean=.. p50=.. p90=.. p99=.. \
+ *        p999=.. max=.. unit=..
+ *   PERF <suite> <name> <key>=<value> unit=..
+ *
+ * Neither suite nor name may contain spaces.
+ */
+#define PERF_SUB_BITS     4
+#define PERF_SUB_CNT      (1U << PERF_SUB_BITS)
+#define PERF_MAX_BITS     36    /* ~68 s in ns */
+#define PERF_BUCKET_CNT   ((PERF_MAX_BITS - PERF_SUB_BITS + 1) * PERF_SUB_CNT)
+
+struct perf_stats {
+	uint64_t cnt;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint32_t buckets[PERF_BUCKET_CNT];
+};
+
+static inline int64_t perf_now_ns(void)
+{
+	int64_t t = 0;
+
+	gettime(0, 0, &t);
+	return t;
+}
+
+#if defined(WITH_PERF_CNTVCT) && defined(__aarch64__)
+static inline uint64_t perf_ticks(void)
+{
+	uint64_t v;
+
+	__asm__ volatile("isb; mrs %0, cntvct_el0" : "=r" (v));
+	return v;
+}
+
+static inline uint64_t perf_ticks_to_ns(uint64_t ticks)
+{
+	uint64_t freq;
+
+	__asm__ volatile("mrs %0, cntfrq_el0" : "=r" (freq));
+	if (!freq)
+		return ticks;
+	return ticks / freq * 1000000000ULL +
+	       ticks % freq * 1000000000ULL / freq;
+}
+#else
+static inline uint64_t perf_ticks(void)
+{
+	return (uint64_t)perf_now_ns();
+}
+
+static inline uint64_t perf_ticks_to_ns(uint64_t ticks)
+{
+	return ticks;
+}
+#endif
+
+void perf_stats_reset(struct perf_stats *st);
+
+/* negative values are counted as 0 */
+void perf_stats_add(struct perf_stats *st, int64_t val);
+
+/* merge src into dst */
+void perf_stats_merge(struct perf_stats *dst, const struct perf_stats *src);
+
+uint64_t perf_stats_mean(const struct perf_stats *st);
+
+/* value at per-mille rank (500 is median), 0 if empty */
+uint64_t perf_stats_pct(const struct perf_stats *st, uint permille);
+
+/* non empty buckets as " lower_bound:count" pairs, returns length */
+int perf_stats_hist_str(const struct perf_stats *st, char *buf, size_t len);
+
+void perf_print_stats(const char *suite, const char *name,
+		      const struct perf_stats *st, const char *unit);
+void perf_print_value(const char *suite, const char *name,
+		      const char *key, int64_t val, const char *unit);
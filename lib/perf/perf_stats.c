@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <trusty_std.h>
+
+#include <lib/perf/perf_stats.h>
+
+static uint perf_bucket(uint64_t val)
+{
+	if (val < PERF_SUB_CNT)
+		return (uint)val;
+
+	uint msb = 63 - __builtin_clzll(val);
+	uint sub = (uint)(val >> (msb - PERF_SUB_BITS)) & (PERF_SUB_CNT - 1);
+	uint idx = (msb - PERF_SUB_BITS + 1) * PERF_SUB_CNT + sub;
+
+	return MIN(idx, PERF_BUCKET_CNT - 1);
+}
+
+/* lower bound of values counted in bucket idx */
+static uint64_t perf_bucket_val(uint idx)
+{
+	if (idx < PERF_SUB_CNT)
+		return idx;
+
+	uint msb = idx / PERF_SUB_CNT + PERF_SUB_BITS - 1;
+	uint sub = idx % PERF_SUB_CNT;
+
+	return ((uint64_t)(PERF_SUB_CNT + sub)) << (msb - PERF_SUB_BITS);
+}
+
+void perf_stats_reset(struct perf_stats *st)
+{
+	memset(st, 0, sizeof(*st));
+}
+
+void perf_stats_add(struct perf_stats *st, int64_t val)
+{
+	uint64_t v = val > 0 ? (uint64_t)val : 0;
+
+	if (!st->cnt || v < st->min)
+		st->min = v;
+	st->cnt++;
+	st->sum += v;
+	if (v > st->max)
+		st->max = v;
+	st->buckets[perf_bucket(v)]++;
+}
+
+void perf_stats_merge(struct perf_stats *dst, const struct perf_stats *src)
+{
+	if (!src->cnt)
+		return;
+
+	if (!dst->cnt || src->min < dst->min)
+		dst->min = src->min;
+	dst->max = MAX(dst->max, src->max);
+	dst->cnt += src->cnt;
+	dst->sum += src->sum;
+	for (uint i = 0; i < PERF_BUCKET_CNT; i++)
+		dst->buckets[i] += src->buckets[i];
+}
+
+uint64_t perf_stats_mean(const struct perf_stats *st)
+{
+	return st->cnt ? st->sum / st->cnt : 0;
+}
+
+/* middle of the value range counted in bucket idx */
+static uint64_t perf_bucket_mid(uint idx)
+{
+	if (idx < PERF_SUB_CNT)
+		return idx;
+
+	uint msb = idx / PERF_SUB_CNT + PERF_SUB_BITS - 1;
+
+	return perf_bucket_val(idx) + ((1ULL << (msb - PERF_SUB_BITS)) >> 1);
+}
+
+uint64_t perf_stats_pct(const struct perf_stats *st, uint permille)
+{
+	uint64_t seen = 0;
+	uint64_t rank = (st->cnt * permille + 999) / 1000;
+
+	if (!st->cnt)
+		return 0;
+
+	for (uint i = 0; i < PERF_BUCKET_CNT; i++) {
+		seen += st->buckets[i];
+		if (seen >= rank)
+			return MAX(MIN(perf_bucket_mid(i), st->max), st->min);
+	}
+	return st->max;
+}
+
+int perf_stats_hist_str(const struct perf_stats *st, char *buf, size_t len)
+{
+	char item[32];
+	size_t pos = 0;
+
+	if (!len)
+		return 0;
+
+	buf[0] = '\0';
+	for (uint i = 0; i < PERF_BUCKET_CNT; i++) {
+		if (!st->buckets[i])
+			continue;
+
+		/* stop at first pair that does not fit as a whole */
+		int n = snprintf(item, sizeof(item), " %llu:%u",
+				 perf_bucket_val(i), st->buckets[i]);
+		if (pos + n >= len)
+			break;
+		memcpy(buf + pos, item, n + 1);
+		pos += n;
+	}
+	return (int)pos;
+}
+
+void perf_print_stats(const char *suite, const char *name,
+		      const struct perf_stats *st, const char *unit)
+{
+	fprintf(stderr, "PERF %s %s cnt=%llu min=%llu mean=%llu p50=%llu "
+		"p90=%llu p99=%llu p999=%llu max=%llu unit=%s\n",
+		suite, name, st->cnt, st->cnt ? st->min : 0,
+		perf_stats_mean(st),
+		perf_stats_pct(st, 500), perf_stats_pct(st, 900),
+		perf_stats_pct(st, 990), perf_stats_pct(st, 999),
+		st->max, unit);
+}
+
+void perf_print_value(const char *suite, const char *name,
+		      const char *key, int64_t val, const char *unit)
+{
+	fprintf(stderr, "PERF %s %s %s=%lld unit=%s\n",
+		suite, name, key, val, unit);
+}
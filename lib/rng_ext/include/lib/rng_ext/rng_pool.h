@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Buffered front end for trusty_rng_hw_rand().
+ *
+ * Every trusty_rng_hw_rand() call is an IPC to the hwrng service. The
+ * pool fetches RNG_POOL_SIZE bytes at a time and serves small requests
+ * from that block, so a stream of nonce sized requests costs one IPC
+ * per RNG_POOL_SIZE bytes. Bytes are wiped from the pool as soon as
+ * they are handed out; requests of RNG_POOL_DIRECT_MIN bytes or more
+ * go straight to the service.
+ */
+#define RNG_POOL_SIZE        1024
+#define RNG_POOL_DIRECT_MIN  (RNG_POOL_SIZE / 2)
+
+struct rng_pool_stats {
+	uint32_t requests;
+	uint32_t refills;
+	uint32_t direct;
+	uint64_t bytes;
+};
+
+/* same contract as trusty_rng_hw_rand() */
+int rng_pool_get(uint8_t *data, size_t len);
+
+/* wipe whatever is left in the pool */
+void rng_pool_flush(void);
+
+void rng_pool_get_stats(struct rng_pool_stats *stats);
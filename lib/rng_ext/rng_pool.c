@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <err.h>
+#include <string.h>
+#include <trusty_std.h>
+#include <lib/rng/trusty_rng.h>
+
+#include <lib/rng_ext/rng_pool.h>
+
+/* unread bytes are _pool[_pos .. RNG_POOL_SIZE) */
+static uint8_t _pool[RNG_POOL_SIZE];
+static size_t _pos = RNG_POOL_SIZE;
+static struct rng_pool_stats _stats;
+
+/* memset that compiler is not allowed to drop */
+static void wipe(void *buf, size_t len)
+{
+	volatile uint8_t *p = buf;
+
+	while (len--)
+		*p++ = 0;
+}
+
+static int refill(void)
+{
+	int rc = trusty_rng_hw_rand(_pool, sizeof(_pool));
+	if (rc != NO_ERROR) {
+		wipe(_pool, sizeof(_pool));
+		_pos = sizeof(_pool);
+		return rc;
+	}
+	_stats.refills++;
+	_pos = 0;
+	return NO_ERROR;
+}
+
+int rng_pool_get(uint8_t *data, size_t len)
+{
+	int rc;
+
+	_stats.requests++;
+
+	if (len >= RNG_POOL_DIRECT_MIN) {
+		_stats.direct++;
+		rc = trusty_rng_hw_rand(data, len);
+		if (rc == NO_ERROR)
+			_stats.bytes += len;
+		return rc;
+	}
+
+	while (len) {
+		if (_pos == sizeof(_pool)) {
+			rc = refill();
+			if (rc != NO_ERROR)
+				return rc;
+		}
+
+		size_t cnt = MIN(len, sizeof(_pool) - _pos);
+		memcpy(data, _pool + _pos, cnt);
+		wipe(_pool + _pos, cnt);
+		_pos += cnt;
+		data += cnt;
+		len -= cnt;
+		_stats.bytes += cnt;
+	}
+	return NO_ERROR;
+}
+
+void rng_pool_flush(void)
+{
+	wipe(_pool, sizeof(_pool));
+	_pos = sizeof(_pool);
+}
+
+void rng_pool_get_stats(struct rng_pool_stats *stats)
+{
+	*stats = _stats;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <lib/storage/storage.h>
+
+#define STORAGE_BATCH_MAX_EXTENTS  32
+#define STORAGE_BATCH_STAGE_SIZE   4096  /* max size of coalesced write */
+
+struct storage_extent {
+    file_handle_t handle;
+    storage_off_t off;
+    const void *buf;
+    size_t len;
+};
+
+/*
+ * Write batch for single storage session.
+ *
+ * Extents are queued with storage_batch_add_write() (possibly for
+ * different files opened in the same session) and sent by
+ * storage_batch_submit(). Writes to consecutive offsets of the same file
+ * are coalesced into one storage_write() through the staging buffer,
+ * and only the last write carries STORAGE_OP_COMPLETE, so the whole
+ * batch lands in a single transaction commit.
+ *
+ * Queued buffers are not copied until submit and must stay valid until
+ * then. The struct is large, so don't put it on the stack.
+ */
+struct storage_batch {
+    storage_session_t session;
+    unsigned cnt;
+    size_t bytes;
+    unsigned writes;         /* storage_write calls made by last submit */
+    struct storage_extent ext[STORAGE_BATCH_MAX_EXTENTS];
+    uint8_t stage[STORAGE_BATCH_STAGE_SIZE];
+};
+
+void storage_batch_init(struct storage_batch *batch, storage_session_t session);
+
+/*
+ * Queue write extent.
+ *
+ * Returns NO_ERROR, ERR_INVALID_ARGS for empty writes or ERR_NO_RESOURCES
+ * when the batch is full (submit it first).
+ */
+int storage_batch_add_write(struct storage_batch *batch, file_handle_t handle,
+                            storage_off_t off, const void *buf, size_t len);
+
+/*
+ * Send all queued extents and, if commit is set, commit the transaction.
+ *
+ * Returns total number of bytes written or negative error. On error the
+ * session transaction is discarded, including writes issued before the
+ * batch that were not yet committed. The batch is empty afterwards in
+ * either case.
+ */
+ssize_t storage_batch_submit(struct storage_batch *batch, bool commit);
+
+/* Drop all queued extents without sending them */
+void storage_batch_discard(struct storage_batch *batch);
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <lib/storage/storage.h>
+
+/*
+ * Read-ahead cache for single open file.
+ *
+ * storage_ra_read() serves reads out of a caller supplied window buffer
+ * and refills the whole window with one storage_read() on a miss, so
+ * sequential small reads cost one round trip per window. Reads as big as
+ * the window go straight to storage.
+ *
+ * The cached data is dropped on storage_ra_write(),
+ * storage_ra_set_file_size() and on storage_ra_end_transaction() for the
+ * owning session. Modifying the file behind the cache's back (plain
+ * storage_write() on the same handle) is not detected.
+ */
+struct storage_ra {
+    struct list_node node;
+    storage_session_t session;
+    file_handle_t handle;
+    uint8_t *buf;
+    size_t window;
+    storage_off_t buf_off;
+    size_t buf_len;
+    bool valid;
+    unsigned hits;      /* reads served from window */
+    unsigned fills;     /* storage_read calls made */
+};
+
+void storage_ra_init(struct storage_ra *ra, storage_session_t session,
+                     file_handle_t handle, void *buf, size_t window);
+void storage_ra_fini(struct storage_ra *ra);
+void storage_ra_invalidate(struct storage_ra *ra);
+
+ssize_t storage_ra_read(struct storage_ra *ra, storage_off_t off,
+                        void *buf, size_t size);
+ssize_t storage_ra_write(struct storage_ra *ra, storage_off_t off,
+                         const void *buf, size_t size, uint32_t opflags);
+int storage_ra_set_file_size(struct storage_ra *ra, storage_off_t file_size,
+                             uint32_t opflags);
+
+/*
+ * storage_end_transaction() that also drops windows of all caches open
+ * in this session: after discard they may hold data that is gone, after
+ * commit other sessions' changes become visible.
+ */
+int storage_ra_end_transaction(storage_session_t session, bool complete);
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <lib/perf/perf_stats.h>
+#include <lib/storage/storage.h>
+
+/*
+ * Instrumented storage client calls.
+ *
+ * The storage_stats_* wrappers take the same arguments and return the
+ * same values as their lib/storage counterparts, and count every call
+ * with its latency and byte count both for the session it belongs to
+ * and for the port the session was opened on. storage_stats_dump() logs
+ * everything collected so far as PERF lines (see lib/perf), latencies in
+ * nanoseconds.
+ */
+#define STORAGE_STATS_MAX_PORTS      4
+#define STORAGE_STATS_MAX_SESSIONS   8
+#define STORAGE_STATS_MAX_FILES     32
+
+enum storage_stats_op {
+    STORAGE_STATS_OP_OPEN,
+    STORAGE_STATS_OP_READ,
+    STORAGE_STATS_OP_WRITE,
+    STORAGE_STATS_OP_SET_SIZE,
+    STORAGE_STATS_OP_END_TRANSACTION,
+    STORAGE_STATS_OP_DELETE,
+    STORAGE_STATS_OP_CNT,
+};
+
+struct storage_op_stats {
+    uint32_t errors;
+    uint64_t bytes;
+    struct perf_stats lat;   // call count is lat.cnt
+};
+
+int storage_stats_open_session(storage_session_t *session_p, const char *port);
+void storage_stats_close_session(storage_session_t session);
+
+int storage_stats_open_file(storage_session_t session, file_handle_t *handle_p,
+                            const char *name, uint32_t flags, uint32_t opflags);
+void storage_stats_close_file(file_handle_t handle);
+int storage_stats_delete_file(storage_session_t session, const char *name,
+                              uint32_t opflags);
+ssize_t storage_stats_read(file_handle_t handle, storage_off_t off,
+                           void *buf, size_t size);
+ssize_t storage_stats_write(file_handle_t handle, storage_off_t off,
+                            const void *buf, size_t size, uint32_t opflags);
+int storage_stats_set_file_size(file_handle_t handle, storage_off_t file_size,
+                                uint32_t opflags);
+int storage_stats_end_transaction(storage_session_t session, bool complete);
+
+/*
+ * Return stats for operation on port, NULL if port has not been seen
+ */
+const struct storage_op_stats *storage_stats_get(const char *port,
+                                                 enum storage_stats_op op);
+
+/* Log all per port and per live session stats */
+void storage_stats_dump(void);
+
+/* Clear all counters, open sessions and files stay tracked */
+void storage_stats_reset(void);
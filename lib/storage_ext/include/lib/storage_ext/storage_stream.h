@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <lib/storage/storage.h>
+
+/*
+ * Streaming sequential writer.
+ *
+ * Data passed to storage_stream_write() in pieces of any size is
+ * collected in a caller supplied block buffer and written out one whole
+ * block at a time, so memory use is one block regardless of file size.
+ * Whole blocks at the start of a piece are written straight from the
+ * caller's data when nothing is pending.
+ *
+ * Every time at least checkpoint bytes have been written since the last
+ * commit, the block write carries STORAGE_OP_COMPLETE. With checkpoint 0
+ * nothing is committed before storage_stream_close().
+ *
+ * The first error is sticky: every later call returns it.
+ */
+struct storage_stream {
+    storage_session_t session;
+    file_handle_t handle;
+    uint8_t *buf;
+    size_t block;
+    size_t fill;                /* bytes pending in buf */
+    storage_off_t off;          /* file offset of buf[0] */
+    size_t checkpoint;
+    storage_off_t committed;    /* file offset covered by last commit */
+    int err;
+    unsigned writes;
+    unsigned commits;
+};
+
+void storage_stream_init(struct storage_stream *s, storage_session_t session,
+                         file_handle_t handle, storage_off_t off,
+                         void *buf, size_t block, size_t checkpoint);
+
+/* Returns len or negative error */
+ssize_t storage_stream_write(struct storage_stream *s,
+                             const void *data, size_t len);
+
+/* Write out pending partial block, optionally committing */
+int storage_stream_flush(struct storage_stream *s, bool commit);
+
+/*
+ * Flush and, if commit is set, commit. Returns file offset right past
+ * the streamed data or negative error.
+ */
+int64_t storage_stream_close(struct storage_stream *s, bool commit);
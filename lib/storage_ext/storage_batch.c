@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <err.h>
+#include <string.h>
+
+#include <lib/storage_ext/storage_batch.h>
+
+void storage_batch_init(struct storage_batch *batch, storage_session_t session)
+{
+    batch->session = session;
+    batch->cnt = 0;
+    batch->bytes = 0;
+    batch->writes = 0;
+}
+
+int storage_batch_add_write(struct storage_batch *batch, file_handle_t handle,
+                            storage_off_t off, const void *buf, size_t len)
+{
+    if (!buf || !len)
+        return ERR_INVALID_ARGS;
+
+    if (batch->cnt == STORAGE_BATCH_MAX_EXTENTS)
+        return ERR_NO_RESOURCES;
+
+    struct storage_extent *ext = &batch->ext[batch->cnt++];
+    ext->handle = handle;
+    ext->off = off;
+    ext->buf = buf;
+    ext->len = len;
+    batch->bytes += len;
+
+    return NO_ERROR;
+}
+
+void storage_batch_discard(struct storage_batch *batch)
+{
+    batch->cnt = 0;
+    batch->bytes = 0;
+}
+
+/*
+ * Number of extents starting at idx that can go out as one write:
+ * same file, back to back offsets and fitting the staging buffer
+ */
+static unsigned coalesce_cnt(const struct storage_batch *batch, unsigned idx)
+{
+    const struct storage_extent *first = &batch->ext[idx];
+    storage_off_t end = first->off + first->len;
+    size_t len = first->len;
+    unsigned cnt = 1;
+
+    while (idx + cnt < batch->cnt) {
+        const struct storage_extent *next = &batch->ext[idx + cnt];
+
+        if (next->handle != first->handle || next->off != end)
+            break;
+        if (len + next->len > STORAGE_BATCH_STAGE_SIZE)
+            break;
+
+        end += next->len;
+        len += next->len;
+        cnt++;
+    }
+
+    return cnt;
+}
+
+ssize_t storage_batch_submit(struct storage_batch *batch, bool commit)
+{
+    int rc;
+    ssize_t total = 0;
+    unsigned i = 0;
+
+    batch->writes = 0;
+
+    if (!batch->cnt) {
+        /* nothing queued: just close transaction if asked to */
+        if (commit) {
+            rc = storage_end_transaction(batch->session, true);
+            if (rc < 0)
+                return rc;
+        }
+        return 0;
+    }
+
+    while (i < batch->cnt) {
+        const struct storage_extent *ext = &batch->ext[i];
+        unsigned cnt = coalesce_cnt(batch, i);
+        bool last = (i + cnt == batch->cnt);
+        uint32_t opflags = (last && commit) ? STORAGE_OP_COMPLETE : 0;
+        const void *buf = ext->buf;
+        size_t len = ext->len;
+
+        if (cnt > 1) {
+            /* gather into staging buffer */
+            len = 0;
+            for (unsigned j = 0; j < cnt; j++) {
+                memcpy(batch->stage + len, ext[j].buf, ext[j].len);
+                len += ext[j].len;
+            }
+            buf = batch->stage;
+        }
+
+        ssize_t wr = storage_write(ext->handle, ext->off, buf, len, opflags);
+        batch->writes++;
+        if (wr < 0 || (size_t)wr != len) {
+            rc = wr < 0 ? (int)wr : ERR_IO;
+            goto err_write;
+        }
+
+        total += wr;
+        i += cnt;
+    }
+
+    storage_batch_discard(batch);
+    return total;
+
+err_write:
+    /* all or nothing: drop whatever part of the batch got through */
+    storage_end_transaction(batch->session, false);
+    storage_batch_discard(batch);
+    return rc;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <err.h>
+#include <string.h>
+
+#include <lib/storage_ext/storage_readahead.h>
+
+/* all initialized caches, for invalidation on transaction end */
+static struct list_node ra_list = LIST_INITIAL_VALUE(ra_list);
+
+void storage_ra_init(struct storage_ra *ra, storage_session_t session,
+                     file_handle_t handle, void *buf, size_t window)
+{
+    ra->session = session;
+    ra->handle = handle;
+    ra->buf = buf;
+    ra->window = window;
+    ra->buf_off = 0;
+    ra->buf_len = 0;
+    ra->valid = false;
+    ra->hits = 0;
+    ra->fills = 0;
+    list_add_tail(&ra_list, &ra->node);
+}
+
+void storage_ra_fini(struct storage_ra *ra)
+{
+    if (list_in_list(&ra->node))
+        list_delete(&ra->node);
+    ra->valid = false;
+}
+
+void storage_ra_invalidate(struct storage_ra *ra)
+{
+    ra->valid = false;
+    ra->buf_len = 0;
+}
+
+ssize_t storage_ra_read(struct storage_ra *ra, storage_off_t off,
+                        void *buf, size_t size)
+{
+    ssize_t rc;
+
+    /* whole request in window */
+    if (ra->valid && off >= ra->buf_off &&
+        off + size <= ra->buf_off + ra->buf_len) {
+        memcpy(buf, ra->buf + (off - ra->buf_off), size);
+        ra->hits++;
+        return size;
+    }
+
+    /* request past end of short (EOF) window: file ends there */
+    if (ra->valid && ra->buf_len < ra->window &&
+        off == ra->buf_off + ra->buf_len) {
+        ra->hits++;
+        return 0;
+    }
+
+    /* big reads gain nothing from window */
+    if (size >= ra->window) {
+        ra->fills++;
+        return storage_read(ra->handle, off, buf, size);
+    }
+
+    /* refill window starting at requested offset */
+    storage_ra_invalidate(ra);
+    ra->fills++;
+    rc = storage_read(ra->handle, off, ra->buf, ra->window);
+    if (rc < 0)
+        return rc;
+
+    ra->buf_off = off;
+    ra->buf_len = (size_t)rc;
+    ra->valid = true;
+
+    size = MIN(size, ra->buf_len);
+    memcpy(buf, ra->buf, size);
+    return size;
+}
+
+ssize_t storage_ra_write(struct storage_ra *ra, storage_off_t off,
+                         const void *buf, size_t size, uint32_t opflags)
+{
+    storage_ra_invalidate(ra);
+    return storage_write(ra->handle, off, buf, size, opflags);
+}
+
+int storage_ra_set_file_size(struct storage_ra *ra, storage_off_t file_size,
+                             uint32_t opflags)
+{
+    storage_ra_invalidate(ra);
+    return storage_set_file_size(ra->handle, file_size, opflags);
+}
+
+int storage_ra_end_transaction(storage_session_t session, bool complete)
+{
+    struct storage_ra *ra;
+
+    list_for_every_entry(&ra_list, ra, struct storage_ra, node) {
+        if (ra->session == session)
+            storage_ra_invalidate(ra);
+    }
+
+    return storage_end_transaction(session, complete);
+}
@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <trusty_std.h>
+
+#include <lib/storage_ext/storage_stats.h>
+
+struct port_stats {
+    const char *port;
+    struct storage_op_stats ops[STORAGE_STATS_OP_CNT];
+};
+
+struct session_stats {
+    bool used;
+    storage_session_t session;
+    struct port_stats *port;
+    struct storage_op_stats ops[STORAGE_STATS_OP_CNT];
+};
+
+struct file_entry {
+    bool used;
+    file_handle_t handle;
+    struct session_stats *ss;
+};
+
+static const char *op_names[STORAGE_STATS_OP_CNT] = {
+    [STORAGE_STATS_OP_OPEN]            = "open",
+    [STORAGE_STATS_OP_READ]            = "read",
+    [STORAGE_STATS_OP_WRITE]           = "write",
+    [STORAGE_STATS_OP_SET_SIZE]        = "set_size",
+    [STORAGE_STATS_OP_END_TRANSACTION] = "end_transaction",
+    [STORAGE_STATS_OP_DELETE]          = "delete",
+};
+
+static struct port_stats ports[STORAGE_STATS_MAX_PORTS];
+static struct session_stats sessions[STORAGE_STATS_MAX_SESSIONS];
+static struct file_entry files[STORAGE_STATS_MAX_FILES];
+
+static void op_stats_add(struct storage_op_stats *st, int64_t ns,
+                         ssize_t rc, size_t bytes)
+{
+    if (rc < 0)
+        st->errors++;
+    else
+        st->bytes += bytes;
+    perf_stats_add(&st->lat, ns);
+}
+
+static struct port_stats *find_port(const char *port, bool create)
+{
+    for (unsigned i = 0; i < countof(ports); i++) {
+        if (ports[i].port && !strcmp(ports[i].port, port))
+            return &ports[i];
+    }
+    if (!create)
+        return NULL;
+    for (unsigned i = 0; i < countof(ports); i++) {
+        if (!ports[i].port) {
+            ports[i].port = port;
+            return &ports[i];
+        }
+    }
+    return NULL;
+}
+
+static struct session_stats *find_session(storage_session_t session)
+{
+    for (unsigned i = 0; i < countof(sessions); i++) {
+        if (sessions[i].used && sessions[i].session == session)
+            return &sessions[i];
+    }
+    return NULL;
+}
+
+static struct file_entry *find_file(file_handle_t handle)
+{
+    for (unsigned i = 0; i < countof(files); i++) {
+        if (files[i].used && files[i].handle == handle)
+            return &files[i];
+    }
+    return NULL;
+}
+
+/*
+ * Account call to session it was made on and to its port. Calls on
+ * sessions or files opened without the wrappers (or after the tables
+ * filled up) are not counted.
+ */
+static void account(struct session_stats *ss, enum storage_stats_op op,
+                    int64_t ns, ssize_t rc, size_t bytes)
+{
+    if (!ss)
+        return;
+
+    op_stats_add(&ss->ops[op], ns, rc, bytes);
+    if (ss->port)
+        op_stats_add(&ss->port->ops[op], ns, rc, bytes);
+}
+
+static struct session_stats *file_session(file_handle_t handle)
+{
+    struct file_entry *fe = find_file(handle);
+    return fe ? fe->ss : NULL;
+}
+
+int storage_stats_open_session(storage_session_t *session_p, const char *port)
+{
+    int rc = storage_open_session(session_p, port);
+    if (rc < 0)
+        return rc;
+
+    for (unsigned i = 0; i < countof(sessions); i++) {
+        if (!sessions[i].used) {
+            memset(&sessions[i], 0, sizeof(sessions[i]));
+            sessions[i].used = true;
+            sessions[i].session = *session_p;
+            sessions[i].port = find_port(port, true);
+            break;
+        }
+    }
+    return rc;
+}
+
+void storage_stats_close_session(storage_session_t session)
+{
+    struct session_stats *ss = find_session(session);
+
+    if (ss) {
+        // drop files left open in this session
+        for (unsigned i = 0; i < countof(files); i++) {
+            if (files[i].used && files[i].ss == ss)
+                files[i].used = false;
+        }
+        ss->used = false;
+    }
+    storage_close_session(session);
+}
+
+int storage_stats_open_file(storage_session_t session, file_handle_t *handle_p,
+                            const char *name, uint32_t flags, uint32_t opflags)
+{
+    struct session_stats *ss = find_session(session);
+
+    int64_t t0 = perf_now_ns();
+    int rc = storage_open_file(session, handle_p, name, flags, opflags);
+    account(ss, STORAGE_STATS_OP_OPEN, perf_now_ns() - t0, rc, 0);
+
+    if (rc >= 0 && ss) {
+        for (unsigned i = 0; i < countof(files); i++) {
+            if (!files[i].used) {
+                files[i].used = true;
+                files[i].handle = *handle_p;
+                files[i].ss = ss;
+                break;
+            }
+        }
+    }
+    return rc;
+}
+
+void storage_stats_close_file(file_handle_t handle)
+{
+    struct file_entry *fe = find_file(handle);
+
+    if (fe)
+        fe->used = false;
+    storage_close_file(handle);
+}
+
+int storage_stats_delete_file(storage_session_t session, const char *name,
+                              uint32_t opflags)
+{
+    int64_t t0 = perf_now_ns();
+    int rc = storage_delete_file(session, name, opflags);
+    account(find_session(session), STORAGE_STATS_OP_DELETE,
+            perf_now_ns() - t0, rc, 0);
+    return rc;
+}
+
+ssize_t storage_stats_read(file_handle_t handle, storage_off_t off,
+                           void *buf, size_t size)
+{
+    int64_t t0 = perf_now_ns();
+    ssize_t rc = storage_read(handle, off, buf, size);
+    account(file_session(handle), STORAGE_STATS_OP_READ,
+            perf_now_ns() - t0, rc, rc > 0 ? (size_t)rc : 0);
+    return rc;
+}
+
+ssize_t storage_stats_write(file_handle_t handle, storage_off_t off,
+                            const void *buf, size_t size, uint32_t opflags)
+{
+    int64_t t0 = perf_now_ns();
+    ssize_t rc = storage_write(handle, off, buf, size, opflags);
+    account(file_session(handle), STORAGE_STATS_OP_WRITE,
+            perf_now_ns() - t0, rc, rc > 0 ? (size_t)rc : 0);
+    return rc;
+}
+
+int storage_stats_set_file_size(file_handle_t handle, storage_off_t file_size,
+                                uint32_t opflags)
+{
+    int64_t t0 = perf_now_ns();
+    int rc = storage_set_file_size(handle, file_size, opflags);
+    account(file_session(handle), STORAGE_STATS_OP_SET_SIZE,
+            perf_now_ns() - t0, rc, 0);
+    return rc;
+}
+
+int storage_stats_end_transaction(storage_session_t session, bool complete)
+{
+    int64_t t0 = perf_now_ns();
+    int rc = storage_end_transaction(session, complete);
+    account(find_session(session), STORAGE_STATS_OP_END_TRANSACTION,
+            perf_now_ns() - t0, rc, 0);
+    return rc;
+}
+
+const struct storage_op_stats *storage_stats_get(const char *port,
+                                                 enum storage_stats_op op)
+{
+    struct port_stats *ps = find_port(port, false);
+
+    if (!ps || op >= STORAGE_STATS_OP_CNT)
+        return NULL;
+    return &ps->ops[op];
+}
+
+static void dump_ops(const char *who, const struct storage_op_stats *ops)
+{
+    char name[64];
+    char hist[160];
+
+    for (unsigned op = 0; op < STORAGE_STATS_OP_CNT; op++) {
+        const struct storage_op_stats *st = &ops[op];
+
+        if (!st->lat.cnt)
+            continue;
+
+        snprintf(name, sizeof(name), "%s.%s", who, op_names[op]);
+        perf_print_stats("storage", name, &st->lat, "ns");
+        perf_print_value("storage", name, "errors", st->errors, "calls");
+        perf_print_value("storage", name, "bytes", st->bytes, "B");
+
+        // non empty buckets as "lower bound in ns:count" pairs
+        perf_stats_hist_str(&st->lat, hist, sizeof(hist));
+        fprintf(stderr, "storage %s hist%s\n", name, hist);
+    }
+}
+
+void storage_stats_dump(void)
+{
+    char who[32];
+
+    for (unsigned i = 0; i < countof(ports); i++) {
+        if (ports[i].port)
+            dump_ops(ports[i].port, ports[i].ops);
+    }
+
+    for (unsigned i = 0; i < countof(sessions); i++) {
+        if (!sessions[i].used)
+            continue;
+        snprintf(who, sizeof(who), "session%d", (int)sessions[i].session);
+        dump_ops(who, sessions[i].ops);
+    }
+}
+
+void storage_stats_reset(void)
+{
+    for (unsigned i = 0; i < countof(ports); i++)
+        memset(ports[i].ops, 0, sizeof(ports[i].ops));
+
+    for (unsigned i = 0; i < countof(sessions); i++)
+        memset(sessions[i].ops, 0, sizeof(sessions[i].ops));
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <err.h>
+#include <string.h>
+
+#include <trusty_std.h>
+
+#include <lib/storage_ext/storage_stream.h>
+
+void storage_stream_init(struct storage_stream *s, storage_session_t session,
+                         file_handle_t handle, storage_off_t off,
+                         void *buf, size_t block, size_t checkpoint)
+{
+    s->session = session;
+    s->handle = handle;
+    s->buf = buf;
+    s->block = block;
+    s->fill = 0;
+    s->off = off;
+    s->checkpoint = checkpoint;
+    s->committed = off;
+    s->err = NO_ERROR;
+    s->writes = 0;
+    s->commits = 0;
+}
+
+/*
+ * Write len bytes at current stream offset, committing if asked to or a
+ * checkpoint is due
+ */
+static int stream_put(struct storage_stream *s, const void *data, size_t len,
+                      bool commit)
+{
+    storage_off_t end = s->off + len;
+
+    if (s->checkpoint && end - s->committed >= s->checkpoint)
+        commit = true;
+
+    ssize_t rc = storage_write(s->handle, s->off, data, len,
+                               commit ? STORAGE_OP_COMPLETE : 0);
+    s->writes++;
+    if (rc < 0 || (size_t)rc != len) {
+        s->err = rc < 0 ? (int)rc : ERR_IO;
+        return s->err;
+    }
+
+    s->off = end;
+    if (commit) {
+        s->committed = end;
+        s->commits++;
+    }
+    return NO_ERROR;
+}
+
+ssize_t storage_stream_write(struct storage_stream *s,
+                             const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    size_t left = len;
+    int rc;
+
+    if (s->err)
+        return s->err;
+
+    while (left) {
+        if (!s->fill && left >= s->block) {
+            /* nothing pending: write whole block from caller data */
+            rc = stream_put(s, p, s->block, false);
+            if (rc < 0)
+                return rc;
+            p += s->block;
+            left -= s->block;
+            continue;
+        }
+
+        size_t n = MIN(left, s->block - s->fill);
+        memcpy(s->buf + s->fill, p, n);
+        s->fill += n;
+        p += n;
+        left -= n;
+
+        if (s->fill == s->block) {
+            rc = stream_put(s, s->buf, s->block, false);
+            if (rc < 0)
+                return rc;
+            s->fill = 0;
+        }
+    }
+
+    return len;
+}
+
+int storage_stream_flush(struct storage_stream *s, bool commit)
+{
+    int rc;
+
+    if (s->err)
+        return s->err;
+
+    if (s->fill) {
+        rc = stream_put(s, s->buf, s->fill, commit);
+        if (rc < 0)
+            return rc;
+        s->fill = 0;
+        return NO_ERROR;
+    }
+
+    if (commit && s->committed != s->off) {
+        /* everything is written, just close transaction */
+        rc = storage_end_transaction(s->session, true);
+        if (rc < 0) {
+            s->err = rc;
+            return rc;
+        }
+        s->committed = s->off;
+        s->commits++;
+    }
+    return NO_ERROR;
+}
+
+int64_t storage_stream_close(struct storage_stream *s, bool commit)
+{
+    int rc = storage_stream_flush(s, commit);
+    if (rc < 0)
+        return rc;
+    return (int64_t)s->off;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <trusty_std.h>
+
+/*
+ * Per test case timings shared by the unittest apps.
+ *
+ * Every suite brackets its test cases with testreg_begin() and
+ * testreg_end(), which keep one record per case in a fixed table.
+ *
+ * ipc-unittest main is the collector. When asked over its ctrl channel,
+ * it opens TESTREG_PORT for TESTREG_COLLECT_TIMEOUT ms. Other suites
+ * built with WITH_TESTREG call testreg_publish() after their run, which
+ * waits for that port and sends their records one message each.
+ *
+ * testreg_report() matches every record against the baseline kept in
+ * the collector's secure storage. It prints one line per record, plus a
+ * summary, to the log and to a channel:
+ *
+ *   TESTREG <suite> <name> time_ns=.. base_ns=.. status=ok|slow|new|fail
+ *   TESTREG summary tests=.. failed=.. slow=.. new=.. threshold_pct=..
+ *
+ * A case is slow if it took more than threshold_pct percent over its
+ * baseline, and at least TESTREG_MIN_DELTA_NS more. Repeated names in
+ * one suite match baseline records in run order.
+ * testreg_save_baseline() replaces the baseline with the records of
+ * passing cases.
+ */
+#define TESTREG_PORT              "com.android.ipc-unittest.testreg"
+#define TESTREG_PORT_MSG_NUM      8
+#define TESTREG_MAX_RECS          160
+#define TESTREG_SUITE_LEN         16
+#define TESTREG_NAME_LEN          40
+#define TESTREG_COLLECT_TIMEOUT   1000        /* ms without new suites */
+#define TESTREG_SLOWDOWN_PCT      20
+#define TESTREG_MIN_DELTA_NS      1000000LL   /* ignore sub-ms jitter */
+#define TESTREG_BASELINE_FILE     "testreg.baseline"
+
+struct testreg_rec {
+	char suite[TESTREG_SUITE_LEN];
+	char name[TESTREG_NAME_LEN];
+	uint64_t time_ns;
+	uint64_t base_ns;       /* 0 - not in baseline */
+	uint32_t ok;
+	uint32_t reserved;
+};
+
+/* recording */
+void testreg_begin(const char *suite, const char *name);
+void testreg_end(bool ok);
+void testreg_drop_suite(const char *suite);
+uint testreg_count(void);
+
+/* publish own records to collector, blocks until it shows up */
+int testreg_publish(void);
+
+/* collector: read records from one publisher until it closes */
+int testreg_receive(handle_t chan, uint timeout);
+
+/* log line and send it to chan unless it is INVALID_IPC_HANDLE */
+int testreg_printf(handle_t chan, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+/* returns number of slow cases or negative error */
+int testreg_report(handle_t chan, uint threshold_pct);
+int testreg_save_baseline(void);
+
+/* internal: baseline matching, used by testreg_report */
+int testreg_load_baseline(void);
+struct testreg_rec *testreg_get(uint idx);
@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <err.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <trusty_std.h>
+
+#include <lib/perf/perf_stats.h>
+#include <lib/testreg/testreg.h>
+
+#define TESTREG_LINE_LEN     160
+#define TESTREG_SEND_TIMEOUT 1000
+
+static struct testreg_rec _recs[TESTREG_MAX_RECS];
+static uint _rec_cnt;
+static uint _dropped;
+
+static struct testreg_rec *_cur;
+static int64_t _cur_start;
+
+static void copy_str(char *dst, const char *src, size_t size)
+{
+	snprintf(dst, size, "%s", src ? src : "");
+}
+
+struct testreg_rec *testreg_get(uint idx)
+{
+	return (idx < _rec_cnt) ? &_recs[idx] : NULL;
+}
+
+uint testreg_count(void)
+{
+	return _rec_cnt;
+}
+
+static struct testreg_rec *alloc_rec(void)
+{
+	if (_rec_cnt == countof(_recs)) {
+		_dropped++;
+		return NULL;
+	}
+	struct testreg_rec *rec = &_recs[_rec_cnt++];
+	memset(rec, 0, sizeof(*rec));
+	return rec;
+}
+
+void testreg_begin(const char *suite, const char *name)
+{
+	_cur = alloc_rec();
+	if (_cur) {
+		copy_str(_cur->suite, suite, sizeof(_cur->suite));
+		copy_str(_cur->name, name, sizeof(_cur->name));
+	}
+	_cur_start = perf_now_ns();
+}
+
+void testreg_end(bool ok)
+{
+	int64_t now = perf_now_ns();
+
+	if (!_cur)
+		return;
+
+	_cur->time_ns = now - _cur_start;
+	_cur->ok = ok;
+	_cur = NULL;
+}
+
+void testreg_drop_suite(const char *suite)
+{
+	uint cnt = 0;
+
+	for (uint i = 0; i < _rec_cnt; i++) {
+		if (strcmp(_recs[i].suite, suite) != 0)
+			_recs[cnt++] = _recs[i];
+	}
+	_rec_cnt = cnt;
+}
+
+/****************************************************************************/
+
+static int send_buf(handle_t chan, const void *buf, size_t len)
+{
+	int rc;
+	uevent_t ev;
+	iovec_t iov = { .base = (void *)buf, .len = len };
+	ipc_msg_t msg = {
+		.num_iov = 1,
+		.iov = &iov,
+		.num_handles = 0,
+		.handles = NULL,
+	};
+
+	for (;;) {
+		rc = send_msg(chan, &msg);
+		if (rc != ERR_NOT_ENOUGH_BUFFER)
+			break;
+
+		/* peer is behind: wait for room */
+		rc = wait(chan, &ev, TESTREG_SEND_TIMEOUT);
+		if (rc < 0)
+			return rc;
+		if (ev.event & IPC_HANDLE_POLL_HUP)
+			return ERR_CHANNEL_CLOSED;
+	}
+
+	if (rc < 0)
+		return rc;
+	return ((size_t)rc == len) ? NO_ERROR : ERR_IO;
+}
+
+int testreg_printf(handle_t chan, const char *fmt, ...)
+{
+	char line[TESTREG_LINE_LEN];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(line, sizeof(line) - 1, fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		return ERR_GENERIC;
+	if ((size_t)len > sizeof(line) - 2)
+		len = sizeof(line) - 2;
+	line[len++] = '\n';
+	line[len] = '\0';
+
+	fprintf(stderr, "%s", line);
+	if (chan == INVALID_IPC_HANDLE)
+		return NO_ERROR;
+	return send_buf(chan, line, len);
+}
+
+int testreg_publish(void)
+{
+	int rc;
+	handle_t chan;
+
+	/* collector only opens its port while it is collecting */
+	rc = connect(TESTREG_PORT, IPC_CONNECT_WAIT_FOR_PORT);
+	if (rc < 0)
+		return rc;
+	chan = (handle_t)rc;
+
+	for (uint i = 0; i < _rec_cnt && rc >= 0; i++)
+		rc = send_buf(chan, &_recs[i], sizeof(_recs[i]));
+
+	close(chan);
+	if (rc < 0)
+		return rc;
+	if (_dropped)
+		fprintf(stderr, "testreg: %u records did not fit\n", _dropped);
+	return _rec_cnt;
+}
+
+/*
+ * Records come grouped by suite: a suite seen for the first time on this
+ * channel replaces whatever an older run of it left.
+ */
+int testreg_receive(handle_t chan, uint timeout)
+{
+	int rc;
+	int cnt = 0;
+	uevent_t ev;
+	ipc_msg_info_t inf;
+	struct testreg_rec in;
+	char last[TESTREG_SUITE_LEN] = "";
+	iovec_t iov = { .base = &in, .len = sizeof(in) };
+	ipc_msg_t msg = {
+		.num_iov = 1,
+		.iov = &iov,
+		.num_handles = 0,
+		.handles = NULL,
+	};
+
+	for (;;) {
+		rc = wait(chan, &ev, timeout);
+		if (rc < 0)
+			return rc;
+
+		if (!(ev.event & IPC_HANDLE_POLL_MSG)) {
+			if (ev.event & (IPC_HANDLE_POLL_HUP |
+			                IPC_HANDLE_POLL_ERROR))
+				return cnt;
+			continue;
+		}
+
+		rc = get_msg(chan, &inf);
+		if (rc != NO_ERROR)
+			return rc;
+		rc = read_msg(chan, inf.id, 0, &msg);
+		put_msg(chan, inf.id);
+		if (rc != (int)sizeof(in))
+			continue;   /* not a record */
+
+		in.suite[sizeof(in.suite) - 1] = '\0';
+		in.name[sizeof(in.name) - 1] = '\0';
+		in.base_ns = 0;
+		if (strcmp(in.suite, last) != 0) {
+			testreg_drop_suite(in.suite);
+			copy_str(last, in.suite, sizeof(last));
+		}
+
+		struct testreg_rec *rec = alloc_rec();
+		if (rec) {
+			*rec = in;
+			cnt++;
+		}
+	}
+}
+
+/****************************************************************************/
+
+int testreg_report(handle_t chan, uint threshold_pct)
+{
+	int rc;
+	uint failed = 0, slow = 0, fresh = 0;
+
+	rc = testreg_load_baseline();
+	if (rc < 0)
+		return rc;
+
+	for (uint i = 0; i < _rec_cnt; i++) {
+		const struct testreg_rec *rec = &_recs[i];
+		const char *status = "ok";
+
+		if (!rec->ok) {
+			status = "fail";
+			failed++;
+		} else if (!rec->base_ns) {
+			status = "new";
+			fresh++;
+		} else if (rec->time_ns * 100 >
+		           rec->base_ns * (100 + threshold_pct) &&
+		           rec->time_ns - rec->base_ns >= TESTREG_MIN_DELTA_NS) {
+			status = "slow";
+			slow++;
+		}
+
+		rc = testreg_printf(chan, "TESTREG %s %s time_ns=%llu "
+		                    "base_ns=%llu status=%s", rec->suite,
+		                    rec->name, rec->time_ns, rec->base_ns,
+		                    status);
+		if (rc < 0)
+			return rc;
+	}
+
+	rc = testreg_printf(chan, "TESTREG summary tests=%u failed=%u "
+	                    "slow=%u new=%u threshold_pct=%u", _rec_cnt,
+	                    failed, slow, fresh, threshold_pct);
+	if (rc < 0)
+		return rc;
+
+	return slow;
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+#include <trusty_std.h>
+
+#include <lib/storage/storage.h>
+#include <lib/testreg/testreg.h>
+
+/*
+ * Baseline is a plain array of struct testreg_rec in the collector's
+ * secure storage, moved TESTREG_IO_RECS records at a time so the whole
+ * table never needs a second copy in memory.
+ */
+#define TESTREG_IO_RECS   16
+
+static struct testreg_rec _io_buf[TESTREG_IO_RECS];
+
+/* next run order match for a baseline record */
+static void match_baseline(const struct testreg_rec *base)
+{
+	for (uint i = 0; i < testreg_count(); i++) {
+		struct testreg_rec *rec = testreg_get(i);
+
+		if (!rec->base_ns &&
+		    strncmp(rec->suite, base->suite, sizeof(rec->suite)) == 0 &&
+		    strncmp(rec->name, base->name, sizeof(rec->name)) == 0) {
+			rec->base_ns = base->time_ns ? base->time_ns : 1;
+			return;
+		}
+	}
+}
+
+int testreg_load_baseline(void)
+{
+	int rc;
+	int cnt = 0;
+	storage_session_t ss;
+	file_handle_t fh;
+	storage_off_t off = 0;
+
+	for (uint i = 0; i < testreg_count(); i++)
+		testreg_get(i)->base_ns = 0;
+
+	rc = storage_open_session(&ss, STORAGE_CLIENT_TD_PORT);
+	if (rc < 0)
+		return rc;
+
+	rc = storage_open_file(ss, &fh, TESTREG_BASELINE_FILE, 0, 0);
+	if (rc == ERR_NOT_FOUND) {
+		rc = NO_ERROR;   /* no baseline yet: everything is new */
+		goto close_session;
+	}
+	if (rc < 0)
+		goto close_session;
+
+	for (;;) {
+		ssize_t len = storage_read(fh, off, _io_buf, sizeof(_io_buf));
+		if (len < 0) {
+			rc = (int)len;
+			break;
+		}
+
+		uint n = (size_t)len / sizeof(_io_buf[0]);
+		for (uint i = 0; i < n; i++)
+			match_baseline(&_io_buf[i]);
+		cnt += n;
+		off += n * sizeof(_io_buf[0]);
+		if (n < countof(_io_buf))
+			break;
+	}
+
+	storage_close_file(fh);
+	if (rc >= 0)
+		rc = cnt;
+
+close_session:
+	storage_close_session(ss);
+	return rc;
+}
+
+static int write_recs(file_handle_t fh, storage_off_t *off, uint n)
+{
+	size_t len = n * sizeof(_io_buf[0]);
+	ssize_t rc = storage_write(fh, *off, _io_buf, len, 0);
+
+	if (rc < 0)
+		return (int)rc;
+	if ((size_t)rc != len)
+		return ERR_IO;
+	*off += len;
+	return NO_ERROR;
+}
+
+int testreg_save_baseline(void)
+{
+	int rc;
+	uint cnt = 0;
+	uint n = 0;
+	storage_session_t ss;
+	file_handle_t fh;
+	storage_off_t off = 0;
+
+	rc = storage_open_session(&ss, STORAGE_CLIENT_TD_PORT);
+	if (rc < 0)
+		return rc;
+
+	rc = storage_open_file(ss, &fh, TESTREG_BASELINE_FILE,
+	                       STORAGE_FILE_OPEN_CREATE |
+	                       STORAGE_FILE_OPEN_TRUNCATE, 0);
+	if (rc < 0)
+		goto close_session;
+
+	/* failed cases have meaningless timings: leave them out */
+	for (uint i = 0; i < testreg_count() && rc >= 0; i++) {
+		const struct testreg_rec *rec = testreg_get(i);
+
+		if (!rec->ok)
+			continue;
+		_io_buf[n++] = *rec;
+		cnt++;
+		if (n == countof(_io_buf)) {
+			rc = write_recs(fh, &off, n);
+			n = 0;
+		}
+	}
+	if (rc >= 0 && n)
+		rc = write_recs(fh, &off, n);
+
+	storage_close_file(fh);
+	if (rc >= 0) {
+		/* all or nothing: uncommitted changes go with the session */
+		rc = storage_end_transaction(ss, true);
+		if (rc >= 0)
+			rc = cnt;
+	}
+
+close_session:
+	storage_close_session(ss);
+	return rc;
+}
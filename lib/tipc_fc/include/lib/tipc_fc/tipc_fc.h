@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <trusty_std.h>
+
+/*
+ * Send side flow control for tipc channels.
+ *
+ * A channel can hold as many unretired messages as the msg_num of the
+ * port it was created from. A client that knows the peer retires every
+ * request before its reply goes out can treat those buffers as credits:
+ * tipc_fc_send() takes one, tipc_fc_credit() gives it back once the
+ * reply has been consumed. As long as the peer keeps that promise no
+ * send ever fails with ERR_NOT_ENOUGH_BUFFER.
+ *
+ * Credit accounting is disabled when initialized with msg_num 0, which
+ * fits senders that cannot tell when the peer retires messages (servers
+ * pushing replies). Either way a send refused by the kernel marks the
+ * channel blocked, and further sends are refused locally without a
+ * syscall until tipc_fc_handle_event() sees IPC_HANDLE_POLL_SEND_UNBLOCKED.
+ * Refused sends leave nothing queued: the caller keeps the message and
+ * sends it again after the unblock.
+ */
+struct tipc_fc {
+	uint credits;       /* free buffers known on peer side */
+	uint max_credits;   /* 0 - no credit accounting */
+	bool blocked;       /* waiting for IPC_HANDLE_POLL_SEND_UNBLOCKED */
+	uint64_t sent;      /* messages accepted by the kernel */
+	uint64_t stalls;    /* sends refused by the kernel */
+};
+
+void tipc_fc_init(struct tipc_fc *fc, uint msg_num);
+
+/* true if tipc_fc_send() would go to the kernel */
+static inline bool tipc_fc_can_send(const struct tipc_fc *fc)
+{
+	return !fc->blocked && (!fc->max_credits || fc->credits);
+}
+
+/* number of sent messages still holding a credit */
+static inline uint tipc_fc_in_flight(const struct tipc_fc *fc)
+{
+	return fc->max_credits - fc->credits;
+}
+
+/*
+ * Send msg if flow control allows it. Returns number of bytes sent,
+ * ERR_NOT_ENOUGH_BUFFER if the message has to wait or another error
+ * returned by send_msg().
+ */
+long tipc_fc_send(struct tipc_fc *fc, handle_t chan, ipc_msg_t *msg);
+
+/* peer retired cnt messages sent earlier */
+void tipc_fc_credit(struct tipc_fc *fc, uint cnt);
+
+/* feed channel events, returns true if sending can resume */
+bool tipc_fc_handle_event(struct tipc_fc *fc, uint32_t event);
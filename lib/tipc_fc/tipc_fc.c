@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <err.h>
+#include <string.h>
+#include <trusty_std.h>
+
+#include <lib/tipc_fc/tipc_fc.h>
+
+void tipc_fc_init(struct tipc_fc *fc, uint msg_num)
+{
+	memset(fc, 0, sizeof(*fc));
+	fc->credits = msg_num;
+	fc->max_credits = msg_num;
+}
+
+long tipc_fc_send(struct tipc_fc *fc, handle_t chan, ipc_msg_t *msg)
+{
+	long rc;
+
+	if (!tipc_fc_can_send(fc))
+		return ERR_NOT_ENOUGH_BUFFER;
+
+	rc = send_msg(chan, msg);
+	if (rc == ERR_NOT_ENOUGH_BUFFER) {
+		/* peer is behind its promise: wait for the kernel to say so */
+		fc->blocked = true;
+		fc->stalls++;
+		return rc;
+	}
+	if (rc < 0)
+		return rc;
+
+	if (fc->max_credits)
+		fc->credits--;
+	fc->sent++;
+	return rc;
+}
+
+void tipc_fc_credit(struct tipc_fc *fc, uint cnt)
+{
+	fc->credits = MIN(fc->credits + cnt, fc->max_credits);
+}
+
+bool tipc_fc_handle_event(struct tipc_fc *fc, uint32_t event)
+{
+	if (event & IPC_HANDLE_POLL_SEND_UNBLOCKED)
+		fc->blocked = false;
+
+	return tipc_fc_can_send(fc);
+}
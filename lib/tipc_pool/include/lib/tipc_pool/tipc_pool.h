@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <trusty_std.h>
+
+/*
+ * Pool of persistent client channels to one named port.
+ *
+ * tipc_pool_get() hands out an idle channel if there is one, otherwise
+ * it connects. tipc_pool_put() returns the channel for reuse. Idle
+ * channels are kept on a stack, so both calls are O(1) apart from the
+ * connect itself. A channel is checked just before it is handed out by
+ * polling it with zero timeout: if the peer has closed it (HUP), it is
+ * in error, or it still holds an unread message, the channel is closed
+ * and the next idle one is tried, falling back to a fresh connect.
+ *
+ * Only protocols without per channel state that outlives a request can
+ * share channels this way: whatever the previous user left on the peer
+ * side is seen by the next one.
+ */
+#define TIPC_POOL_MAX_IDLE   4     /* idle channels kept per pool */
+#define TIPC_POOL_PATH_MAX  64
+
+struct tipc_pool_stats {
+	uint64_t gets;       /* channels handed out */
+	uint64_t hits;       /* ... of them idle ones */
+	uint64_t connects;   /* new connections made */
+	uint64_t stale;      /* idle channels found closed or unusable */
+	uint64_t dropped;    /* channels closed on put */
+};
+
+struct tipc_pool {
+	char path[TIPC_POOL_PATH_MAX];
+	uint timeout;                     /* connect timeout, ms */
+	uint idle_cnt;
+	handle_t idle[TIPC_POOL_MAX_IDLE];
+	struct tipc_pool_stats stats;
+};
+
+int tipc_pool_init(struct tipc_pool *pool, const char *path, uint timeout);
+
+/* returns channel handle or negative error */
+int tipc_pool_get(struct tipc_pool *pool);
+
+/*
+ * Give channel back. A negative status (error seen while using it)
+ * closes the channel instead of keeping it.
+ */
+void tipc_pool_put(struct tipc_pool *pool, handle_t chan, int status);
+
+/* close all idle channels */
+void tipc_pool_drain(struct tipc_pool *pool);
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <err.h>
+#include <stdbool.h>
+#include <string.h>
+#include <trusty_std.h>
+
+#include <lib/tipc_pool/tipc_pool.h>
+
+int tipc_pool_init(struct tipc_pool *pool, const char *path, uint timeout)
+{
+	size_t len = strlen(path);
+
+	if (len >= sizeof(pool->path))
+		return ERR_INVALID_ARGS;
+
+	memset(pool, 0, sizeof(*pool));
+	memcpy(pool->path, path, len + 1);
+	pool->timeout = timeout;
+	return NO_ERROR;
+}
+
+static int tipc_pool_connect(struct tipc_pool *pool)
+{
+	int rc;
+	uevent_t evt;
+	handle_t chan;
+
+	rc = connect(pool->path, IPC_CONNECT_ASYNC | IPC_CONNECT_WAIT_FOR_PORT);
+	if (rc < 0)
+		return rc;
+
+	chan = (handle_t) rc;
+	rc = wait(chan, &evt, pool->timeout);
+	if (rc == NO_ERROR) {
+		if (evt.event & IPC_HANDLE_POLL_HUP)
+			rc = ERR_CHANNEL_CLOSED;
+		else if (evt.event & IPC_HANDLE_POLL_READY)
+			return chan;
+		else
+			rc = ERR_BAD_STATE;
+	}
+	close(chan);
+	return rc;
+}
+
+/*
+ *  Idle channel has no business getting events other than a late
+ *  SEND_UNBLOCKED: anything else means it cannot be handed out
+ */
+static bool tipc_pool_chan_ok(handle_t chan)
+{
+	uevent_t evt;
+	int rc = wait(chan, &evt, 0);
+
+	if (rc == ERR_TIMED_OUT)
+		return true;
+	if (rc != NO_ERROR)
+		return false;
+
+	return !(evt.event & (IPC_HANDLE_POLL_HUP | IPC_HANDLE_POLL_ERROR |
+	                      IPC_HANDLE_POLL_MSG));
+}
+
+int tipc_pool_get(struct tipc_pool *pool)
+{
+	int rc;
+
+	while (pool->idle_cnt) {
+		handle_t chan = pool->idle[--pool->idle_cnt];
+
+		if (tipc_pool_chan_ok(chan)) {
+			pool->stats.gets++;
+			pool->stats.hits++;
+			return chan;
+		}
+		pool->stats.stale++;
+		close(chan);
+	}
+
+	rc = tipc_pool_connect(pool);
+	if (rc < 0)
+		return rc;
+
+	pool->stats.connects++;
+	pool->stats.gets++;
+	return rc;
+}
+
+void tipc_pool_put(struct tipc_pool *pool, handle_t chan, int status)
+{
+	if (status < 0 || pool->idle_cnt == countof(pool->idle)) {
+		pool->stats.dropped++;
+		close(chan);
+		return;
+	}
+	pool->idle[pool->idle_cnt++] = chan;
+}
+
+void tipc_pool_drain(struct tipc_pool *pool)
+{
+	while (pool->idle_cnt)
+		close(pool->idle[--pool->idle_cnt]);
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <trusty_std.h>
+
+#include <lib/tipc_fc/tipc_fc.h>
+
+/*
+ * Request/reply helpers for channels carrying one outstanding request.
+ *
+ * tipc_call() sends a request and returns once its reply has been read
+ * into the caller's buffer and retired. The kernel has no combined
+ * send-and-receive syscall, so this is still send_msg, wait, get_msg,
+ * read_msg and put_msg. With TIPC_CALL_POLL_FIRST, get_msg is tried
+ * right after the send and wait is skipped if the reply is already
+ * queued (peer on another core, or run while we were descheduled). If
+ * it is not, the call costs one syscall more, so the flag only pays off
+ * for fast peers: see the rpc benchmark in ipc-unittest.
+ *
+ * tipc_reply() is the server side: it retires the request and sends the
+ * reply, in that order, so the queue slot is free before the client can
+ * see the reply. If the reply cannot be sent the request is retired all
+ * the same; the caller keeps the reply and resends it.
+ */
+#define TIPC_CALL_POLL_FIRST   (1U << 0)
+
+struct tipc_call_stats {
+	uint64_t calls;
+	uint64_t polled;     /* reply was there before wait */
+	uint64_t waited;
+	uint64_t errors;
+};
+
+/* returns reply length or negative error */
+int tipc_call(handle_t chan, ipc_msg_t *req, ipc_msg_t *reply,
+              uint32_t timeout, uint32_t flags);
+
+/*
+ * Retire msg_id and send reply through fc (may be NULL). Returns result
+ * of the send.
+ */
+long tipc_reply(handle_t chan, uint32_t msg_id, ipc_msg_t *reply,
+                struct tipc_fc *fc);
+
+void tipc_call_get_stats(struct tipc_call_stats *stats);
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <err.h>
+#include <trusty_std.h>
+
+#include <lib/tipc_rpc/tipc_rpc.h>
+
+static struct tipc_call_stats _stats;
+
+static int tipc_call_read(handle_t chan, const ipc_msg_info_t *inf,
+                          ipc_msg_t *reply)
+{
+	int rc = read_msg(chan, inf->id, 0, reply);
+
+	put_msg(chan, inf->id);
+	if (rc < 0)
+		return rc;
+
+	/* truncated reply is useless to the caller */
+	return ((size_t)rc < inf->len) ? ERR_TOO_BIG : rc;
+}
+
+static int _tipc_call(handle_t chan, ipc_msg_t *req, ipc_msg_t *reply,
+                      uint32_t timeout, uint32_t flags)
+{
+	int rc;
+	uevent_t uevt;
+	ipc_msg_info_t inf;
+
+	rc = send_msg(chan, req);
+	if (rc < 0)
+		return rc;
+
+	if (flags & TIPC_CALL_POLL_FIRST) {
+		rc = get_msg(chan, &inf);
+		if (rc == NO_ERROR) {
+			_stats.polled++;
+			return tipc_call_read(chan, &inf, reply);
+		}
+		if (rc != ERR_NO_MSG)
+			return rc;
+	}
+
+	_stats.waited++;
+	for (;;) {
+		rc = wait(chan, &uevt, timeout);
+		if (rc != NO_ERROR)
+			return rc;
+		if (uevt.event & IPC_HANDLE_POLL_MSG)
+			break;
+		if (uevt.event & (IPC_HANDLE_POLL_HUP | IPC_HANDLE_POLL_ERROR))
+			return ERR_CHANNEL_CLOSED;
+		/* a late SEND_UNBLOCKED can show up first */
+	}
+
+	rc = get_msg(chan, &inf);
+	if (rc != NO_ERROR)
+		return rc;
+
+	return tipc_call_read(chan, &inf, reply);
+}
+
+int tipc_call(handle_t chan, ipc_msg_t *req, ipc_msg_t *reply,
+              uint32_t timeout, uint32_t flags)
+{
+	int rc;
+
+	_stats.calls++;
+	rc = _tipc_call(chan, req, reply, timeout, flags);
+	if (rc < 0)
+		_stats.errors++;
+	return rc;
+}
+
+long tipc_reply(handle_t chan, uint32_t msg_id, ipc_msg_t *reply,
+                struct tipc_fc *fc)
+{
+	long rc;
+
+	rc = put_msg(chan, msg_id);
+	if (rc != NO_ERROR)
+		return rc;
+
+	return fc ? tipc_fc_send(fc, chan, reply) : send_msg(chan, reply);
+}
+
+void tipc_call_get_stats(struct tipc_call_stats *stats)
+{
+	*stats = _stats;
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <trusty_std.h>
+
+/*
+ * Minimal framework for tasks serving a fixed set of IPC ports.
+ *
+ * A task describes its services with a constant table of struct tipc_srv
+ * and declares a context for it with TIPC_SRV_CTX_DEFINE. The framework
+ * creates all ports, runs the event loop and dispatches every event to
+ * the tipc_event_handler attached to the handle cookie. Per channel
+ * states come from a slab allocated once at startup.
+ *
+ * With ctx->lazy_port_state set, tipc_init_services only creates ports;
+ * a service's port_state_size block is allocated when its first
+ * connection request is dispatched, just before the port handler runs.
+ * If that allocation fails, the request is accepted and closed at once
+ * and the allocation is retried on the next one. Either way the time
+ * from publishing each port to its first connection request is
+ * reported as a "PERF tipc_srv <name> ttfa=" line.
+ */
+
+/* Expected limits: should be in sync with kernel settings */
+#ifndef TIPC_SRV_MAX_HANDLES
+#define TIPC_SRV_MAX_HANDLES       64   /* max number of user handles */
+#endif
+
+/*
+ * Dispatch batching: after blocking for the first event keep polling with
+ * zero timeout and dispatch up to TIPC_DISPATCH_BATCH_MAX ready events
+ * before blocking again. Once the same handle has been dispatched
+ * TIPC_DISPATCH_HANDLE_MAX times within one batch the batch ends early, so
+ * a single busy channel keeps batches short and stats current. This does
+ * not reorder events: which ready handle goes next is up to wait_any().
+ */
+#define TIPC_DISPATCH_BATCH_MAX       16
+#define TIPC_DISPATCH_HANDLE_MAX       4
+#define TIPC_DISPATCH_STATS_INTERVAL 4096  /* wakeups between reports */
+
+typedef void (*event_handler_proc_t) (const uevent_t *ev);
+
+typedef struct tipc_event_handler {
+	event_handler_proc_t proc;
+	void *priv;
+} tipc_event_handler_t;
+
+typedef struct tipc_srv {
+	const char *name;
+	uint   msg_num;
+	size_t msg_size;
+	uint   port_flags;
+	size_t port_state_size;
+	size_t chan_state_size;
+	uint   max_chan_cnt;    /* max open channels, 0 - no limit */
+	event_handler_proc_t port_handler;
+	event_handler_proc_t chan_handler;
+} tipc_srv_t;
+
+struct tipc_srv_ctx;
+
+typedef struct tipc_srv_state {
+	const struct tipc_srv *service;
+	handle_t port;
+	void *priv;
+	tipc_event_handler_t handler;
+	struct tipc_srv_ctx *ctx;
+	uint chan_cnt;
+	int64_t published_ns;    /* first time port was created */
+	int64_t first_accept_ns; /* first connection request, 0 - none yet */
+} tipc_srv_state_t;
+
+typedef struct tipc_chan_slot tipc_chan_slot_t;
+
+typedef struct tipc_chan_pool {
+	uint8_t *mem;
+	size_t slot_size;
+	uint slot_cnt;
+	uint free_cnt;
+	tipc_chan_slot_t *free_list;
+} tipc_chan_pool_t;
+
+typedef struct tipc_dispatch_stats {
+	uint wakeups;
+	uint events;
+	uint busy_ends;   /* batches ended by TIPC_DISPATCH_HANDLE_MAX */
+	uint max_batch;
+	uint batch_hist[TIPC_DISPATCH_BATCH_MAX + 1];
+} tipc_dispatch_stats_t;
+
+typedef struct tipc_srv_ctx {
+	const struct tipc_srv *services;
+	struct tipc_srv_state *states;
+	uint srv_cnt;
+	bool stopped;
+	bool lazy_port_state;   /* defer port states to first connection */
+	tipc_chan_pool_t chan_pool;
+	tipc_dispatch_stats_t stats;
+	/* optional, called after every dispatch stats report */
+	void (*report_hook)(struct tipc_srv_ctx *ctx);
+} tipc_srv_ctx_t;
+
+/*
+ * Declare context named _ctx serving constant array _services
+ */
+#define TIPC_SRV_CTX_DEFINE(_ctx, _services)                               \
+	static struct tipc_srv_state _ctx##_states[countof(_services)] = {  \
+		[0 ... (countof(_services) - 1)] = {                         \
+			.port = INVALID_IPC_HANDLE,                          \
+		},                                                           \
+	};                                                                   \
+	static struct tipc_srv_ctx _ctx = {                                  \
+		.services = _services,                                       \
+		.states = _ctx##_states,                                     \
+		.srv_cnt = countof(_services),                               \
+	}
+
+/* service life cycle */
+int  tipc_init_services(struct tipc_srv_ctx *ctx);
+void tipc_kill_services(struct tipc_srv_ctx *ctx);
+int  tipc_restart_service(struct tipc_srv_state *state);
+
+/* event loop: returns when ctx->stopped is set by one of handlers */
+int  tipc_run_services(struct tipc_srv_ctx *ctx);
+uint tipc_dispatch_events(struct tipc_srv_ctx *ctx);
+void tipc_dispatch_event(const uevent_t *ev);
+void tipc_report_dispatch_stats(struct tipc_srv_ctx *ctx);
+void tipc_report_accept_stats(struct tipc_srv_ctx *ctx);
+
+/* helpers for port handlers */
+struct tipc_srv_state *tipc_get_srv_state(const uevent_t *ev);
+bool tipc_handle_port_errors(const uevent_t *ev);
+
+/* per channel states */
+void *tipc_chan_state_alloc(struct tipc_srv_state *state);
+void  tipc_chan_state_free(void *chan_state);
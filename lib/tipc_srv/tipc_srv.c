@@ -0,0 +1,565 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <err.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <trusty_std.h>
+
+#include <lib/memprof/memprof.h>
+#include <lib/perf/perf_stats.h>
+#include <lib/tipc_srv/tipc_srv.h>
+
+#define LOG_TAG "tipc-srv"
+
+#define TLOGI(fmt, ...) \
+    fprintf(stderr, "%s: %d: " fmt, LOG_TAG, __LINE__,  ## __VA_ARGS__)
+
+/*
+ * Every channel state slot starts with a small header pointing to the
+ * owning service while in use and to the next free slot otherwise.
+ */
+#define CHAN_SLOT_ALIGN  8
+
+struct tipc_chan_slot {
+	union {
+		struct tipc_chan_slot *next;
+		struct tipc_srv_state *owner;
+	};
+	uint8_t data[0] __attribute__((aligned(CHAN_SLOT_ALIGN)));
+};
+
+/************************************************************************/
+
+struct tipc_srv_state *tipc_get_srv_state(const uevent_t *ev)
+{
+	return containerof(ev->cookie, struct tipc_srv_state, handler);
+}
+
+static void _destroy_service(struct tipc_srv_state *state)
+{
+	if (!state) {
+		TLOGI("non-null state expected\n");
+		return;
+	}
+
+	/* free state if any */
+	if (state->priv) {
+		free(state->priv);
+		state->priv = NULL;
+	}
+
+	/* close port */
+	if (state->port != INVALID_IPC_HANDLE) {
+		int rc = close(state->port);
+		if (rc != NO_ERROR) {
+			TLOGI("Failed (%d) to close port %d\n",
+			       rc, state->port);
+		}
+		state->port = INVALID_IPC_HANDLE;
+	}
+
+	/* reset handler */
+	state->service = NULL;
+	state->handler.proc = NULL;
+	state->handler.priv = NULL;
+}
+
+static int _alloc_port_state(struct tipc_srv_state *state)
+{
+	const struct tipc_srv *srv = state->service;
+
+	if (!srv->port_state_size || state->priv)
+		return NO_ERROR;
+
+	state->priv = calloc(1, srv->port_state_size);
+	return state->priv ? NO_ERROR : ERR_NO_MEMORY;
+}
+
+/*
+ *  Installed on every new port until its first connection request:
+ *  records time to first accept and, in lazy mode, allocates port state
+ *  before handing over to the service's port handler.
+ */
+static void _port_first_event(const uevent_t *ev)
+{
+	uuid_t peer_uuid;
+	struct tipc_srv_state *state = tipc_get_srv_state(ev);
+	const struct tipc_srv *srv = state->service;
+
+	if (ev->event != IPC_HANDLE_POLL_READY) {
+		/* errors: port handler restarts service, which rearms us */
+		srv->port_handler(ev);
+		return;
+	}
+
+	if (_alloc_port_state(state) < 0) {
+		/* cannot serve it: refuse connection, try again next time */
+		TLOGI("%s: no memory for port state, dropping connection\n",
+		      srv->name);
+		int rc = accept(ev->handle, &peer_uuid);
+		if (rc >= 0)
+			close((handle_t)rc);
+		return;
+	}
+
+	if (!state->first_accept_ns) {
+		state->first_accept_ns = perf_now_ns();
+		perf_print_value("tipc_srv", srv->name, "ttfa",
+		                 state->first_accept_ns - state->published_ns,
+		                 "ns");
+	}
+
+	state->handler.proc = srv->port_handler;
+	srv->port_handler(ev);
+}
+
+/*
+ *  Create service
+ */
+static int _create_service(const struct tipc_srv *srv,
+                           struct tipc_srv_state *state)
+{
+	if (!srv || !state) {
+		TLOGI("null service specified: %p: %p\n", srv, state);
+		return ERR_INVALID_ARGS;
+	}
+
+	/* create port */
+	int rc = port_create(srv->name, srv->msg_num, srv->msg_size,
+			     srv->port_flags);
+	if (rc < 0) {
+		TLOGI("Failed (%d) to create port\n", rc);
+		return rc;
+	}
+
+	/* setup port state  */
+	state->port = (handle_t)rc;
+	state->handler.proc = _port_first_event;
+	state->handler.priv = state;
+	state->service = srv;
+	state->priv = NULL;
+
+	if (!state->ctx->lazy_port_state) {
+		/* allocate port state */
+		rc = _alloc_port_state(state);
+		if (rc < 0)
+			goto err_calloc;
+	}
+
+	/* attach handler to port handle */
+	rc = set_cookie(state->port, &state->handler);
+	if (rc < 0) {
+		TLOGI("Failed (%d) to set cookie on port %d\n",
+		      rc, state->port);
+		goto err_set_cookie;
+	}
+
+	/* restarts keep the original publish time */
+	if (!state->published_ns)
+		state->published_ns = perf_now_ns();
+
+	return NO_ERROR;
+
+err_calloc:
+err_set_cookie:
+	_destroy_service(state);
+	return rc;
+}
+
+/*
+ *  Restart specified service
+ */
+int tipc_restart_service(struct tipc_srv_state *state)
+{
+	if (!state) {
+		TLOGI("non-null state expected\n");
+		return ERR_INVALID_ARGS;
+	}
+
+	/* open channels keep their states: they are not tied to port */
+	const struct tipc_srv *srv = state->service;
+	_destroy_service(state);
+	return _create_service(srv, state);
+}
+
+/*
+ *  Handle common port errors
+ */
+bool tipc_handle_port_errors(const uevent_t *ev)
+{
+	if ((ev->event & IPC_HANDLE_POLL_ERROR) ||
+	    (ev->event & IPC_HANDLE_POLL_HUP) ||
+	    (ev->event & IPC_HANDLE_POLL_MSG) ||
+	    (ev->event & IPC_HANDLE_POLL_SEND_UNBLOCKED)) {
+		/* should never happen with port handles */
+		TLOGI("error event (0x%x) for port (%d)\n",
+		       ev->event, ev->handle);
+
+		/* recreate service */
+		tipc_restart_service(tipc_get_srv_state(ev));
+		return true;
+	}
+
+	return false;
+}
+
+/************************************************************************/
+
+/*
+ * Every port owns a handle, so there can never be more than
+ * (TIPC_SRV_MAX_HANDLES - number of services) channels open at once.
+ * If every service that needs channel states caps its channel count,
+ * the slab is further trimmed to the sum of those caps.
+ */
+static uint chan_pool_slot_cnt(const struct tipc_srv_ctx *ctx)
+{
+	uint cnt = 0;
+	uint max_cnt = TIPC_SRV_MAX_HANDLES - ctx->srv_cnt;
+
+	for (uint i = 0; i < ctx->srv_cnt; i++) {
+		const struct tipc_srv *srv = &ctx->services[i];
+
+		if (!srv->chan_state_size)
+			continue;
+		if (!srv->max_chan_cnt)
+			return max_cnt;
+		cnt += srv->max_chan_cnt;
+	}
+
+	return MIN(cnt, max_cnt);
+}
+
+/*
+ *  Allocate channel state slab big enough for all services
+ */
+static int chan_pool_init(struct tipc_srv_ctx *ctx)
+{
+	tipc_chan_pool_t *pool = &ctx->chan_pool;
+	size_t data_size = 0;
+
+	for (uint i = 0; i < ctx->srv_cnt; i++)
+		data_size = MAX(data_size, ctx->services[i].chan_state_size);
+
+	memset(pool, 0, sizeof(*pool));
+	if (!data_size)
+		return NO_ERROR; /* nobody needs channel states */
+
+	data_size = (data_size + CHAN_SLOT_ALIGN - 1) &
+	            ~(size_t)(CHAN_SLOT_ALIGN - 1);
+	pool->slot_size = sizeof(tipc_chan_slot_t) + data_size;
+	pool->slot_cnt  = chan_pool_slot_cnt(ctx);
+	pool->mem = calloc(pool->slot_cnt, pool->slot_size);
+	if (!pool->mem) {
+		TLOGI("failed to allocate %u channel states of %zu bytes\n",
+		      pool->slot_cnt, pool->slot_size);
+		pool->slot_cnt = 0;
+		return ERR_NO_MEMORY;
+	}
+
+	/* thread all slots onto free list */
+	for (uint i = pool->slot_cnt; i > 0; i--) {
+		tipc_chan_slot_t *slot = (tipc_chan_slot_t *)
+		                  (pool->mem + (i - 1) * pool->slot_size);
+		slot->next = pool->free_list;
+		pool->free_list = slot;
+	}
+	pool->free_cnt = pool->slot_cnt;
+
+	return NO_ERROR;
+}
+
+static void chan_pool_fini(struct tipc_srv_ctx *ctx)
+{
+	tipc_chan_pool_t *pool = &ctx->chan_pool;
+
+	if (pool->free_cnt != pool->slot_cnt) {
+		TLOGI("%u channel state(s) still in use\n",
+		      pool->slot_cnt - pool->free_cnt);
+	}
+	free(pool->mem);
+	memset(pool, 0, sizeof(*pool));
+}
+
+/*
+ *  Get zeroed channel state for specified service.
+ *
+ *  Returns NULL if the pool is exhausted, the service reached its
+ *  max_chan_cnt or does not declare chan_state_size.
+ */
+void *tipc_chan_state_alloc(struct tipc_srv_state *state)
+{
+	const struct tipc_srv *srv = state->service;
+	tipc_chan_pool_t *pool = &state->ctx->chan_pool;
+	tipc_chan_slot_t *slot = pool->free_list;
+
+	if (!srv->chan_state_size)
+		return NULL;
+
+	if (srv->max_chan_cnt && state->chan_cnt >= srv->max_chan_cnt) {
+		TLOGI("%s: reached max of %u channels\n",
+		      srv->name, srv->max_chan_cnt);
+		return NULL;
+	}
+
+	if (!slot) {
+		TLOGI("%s: all %u channel states in use\n",
+		      srv->name, pool->slot_cnt);
+		return NULL;
+	}
+
+	pool->free_list = slot->next;
+	pool->free_cnt--;
+	slot->owner = state;
+	state->chan_cnt++;
+	memset(slot->data, 0, srv->chan_state_size);
+	return slot->data;
+}
+
+/*
+ *  Return channel state to the pool it came from
+ */
+void tipc_chan_state_free(void *chan_state)
+{
+	if (!chan_state)
+		return;
+
+	tipc_chan_slot_t *slot = containerof(chan_state,
+	                                     tipc_chan_slot_t, data);
+	struct tipc_srv_state *state = slot->owner;
+	tipc_chan_pool_t *pool = &state->ctx->chan_pool;
+
+	assert((uint8_t *)slot >= pool->mem &&
+	       (uint8_t *)slot < pool->mem + pool->slot_cnt * pool->slot_size);
+	assert(state->chan_cnt);
+
+	state->chan_cnt--;
+	slot->next = pool->free_list;
+	pool->free_list = slot;
+	pool->free_cnt++;
+}
+
+/************************************************************************/
+
+/*
+ *  Kill all services
+ */
+void tipc_kill_services(struct tipc_srv_ctx *ctx)
+{
+	/* close any opened ports */
+	for (uint i = 0; i < ctx->srv_cnt; i++) {
+		_destroy_service(&ctx->states[i]);
+	}
+
+	chan_pool_fini(ctx);
+}
+
+/*
+ *  Initialize all services
+ */
+int tipc_init_services(struct tipc_srv_ctx *ctx)
+{
+	int rc;
+	int64_t start = perf_now_ns();
+
+	ctx->stopped = false;
+	memset(&ctx->stats, 0, sizeof(ctx->stats));
+
+	rc = chan_pool_init(ctx);
+	if (rc < 0)
+		return rc;
+
+	for (uint i = 0; i < ctx->srv_cnt; i++) {
+		ctx->states[i].ctx = ctx;
+		ctx->states[i].chan_cnt = 0;
+		ctx->states[i].published_ns = 0;
+		ctx->states[i].first_accept_ns = 0;
+		rc = _create_service(&ctx->services[i], &ctx->states[i]);
+		if (rc < 0) {
+			TLOGI("Failed (%d) to create service %s\n",
+			      rc, ctx->services[i].name);
+			return rc;
+		}
+	}
+
+	/* time until the last port is published */
+	perf_print_value("tipc_srv", ctx->services[0].name,
+	                 ctx->lazy_port_state ? "init_lazy" : "init",
+	                 perf_now_ns() - start, "ns");
+
+	return NO_ERROR;
+}
+
+/************************************************************************/
+
+/*
+ *  Dispatch event
+ */
+void tipc_dispatch_event(const uevent_t *ev)
+{
+	assert(ev);
+
+	if (ev->event == IPC_HANDLE_POLL_NONE) {
+		/* not really an event, do nothing */
+		TLOGI("got an empty event\n");
+		return;
+	}
+
+	if (ev->handle == INVALID_IPC_HANDLE) {
+		/* not a valid handle  */
+		TLOGI("got an event (0x%x) with invalid handle (%d)",
+		      ev->event, ev->handle);
+		return;
+	}
+
+	/* check if we have handler */
+	struct tipc_event_handler *handler = ev->cookie;
+	if (handler && handler->proc) {
+		/* invoke it */
+		handler->proc(ev);
+		return;
+	}
+
+	/* no handler? close it */
+	TLOGI("no handler for event (0x%x) with handle %d\n",
+	       ev->event, ev->handle);
+	close(ev->handle);
+
+	return;
+}
+
+/*
+ *  Log and reset event batching stats
+ */
+void tipc_report_dispatch_stats(struct tipc_srv_ctx *ctx)
+{
+	char buf[128];
+	int len = 0;
+	tipc_dispatch_stats_t *st = &ctx->stats;
+
+	if (!st->wakeups)
+		return;
+
+	/* events per wakeup histogram as "batch_size:count" pairs */
+	for (uint i = 1; i <= TIPC_DISPATCH_BATCH_MAX; i++) {
+		if (st->batch_hist[i] && len < (int)sizeof(buf)) {
+			len += snprintf(buf + len, sizeof(buf) - len, " %u:%u",
+			                i, st->batch_hist[i]);
+		}
+	}
+	buf[MIN((size_t)len, sizeof(buf) - 1)] = '\0';
+
+	TLOGI("dispatch: %u wakeups, %u events (%u.%02u per wakeup), "
+	      "max %u, ended by busy handle %u, hist%s\n",
+	      st->wakeups, st->events, st->events / st->wakeups,
+	      (st->events % st->wakeups) * 100 / st->wakeups,
+	      st->max_batch, st->busy_ends, buf);
+
+	memset(st, 0, sizeof(*st));
+
+	if (ctx->report_hook)
+		ctx->report_hook(ctx);
+}
+
+/*
+ *  Log services that never saw a connection request
+ */
+void tipc_report_accept_stats(struct tipc_srv_ctx *ctx)
+{
+	uint idle = 0;
+
+	for (uint i = 0; i < ctx->srv_cnt; i++) {
+		if (!ctx->states[i].first_accept_ns) {
+			TLOGI("%s: no connections\n", ctx->services[i].name);
+			idle++;
+		}
+	}
+
+	TLOGI("%u of %u services connected to\n",
+	      ctx->srv_cnt - idle, ctx->srv_cnt);
+}
+
+/*
+ *  Block for next event then dispatch all ready events up to the batch cap
+ */
+uint tipc_dispatch_events(struct tipc_srv_ctx *ctx)
+{
+	int rc;
+	uint cnt = 0;
+	bool busy_end = false;
+	uevent_t event;
+	uint8_t handle_cnt[TIPC_SRV_MAX_HANDLES];
+
+	memset(handle_cnt, 0, sizeof(handle_cnt));
+
+	while (cnt < TIPC_DISPATCH_BATCH_MAX && !ctx->stopped) {
+		event.handle = INVALID_IPC_HANDLE;
+		event.event  = 0;
+		event.cookie = NULL;
+		rc = wait_any(&event, cnt ? 0 : -1);
+		if (rc == ERR_TIMED_OUT && cnt)
+			break; /* nothing else is ready */
+		if (rc < 0) {
+			TLOGI("wait_any failed (%d)", rc);
+			break;
+		}
+		if (rc != NO_ERROR)
+			continue;
+
+		/* got an event */
+		cnt++;
+		tipc_dispatch_event(&event);
+
+		if (event.handle >= 0 && event.handle < TIPC_SRV_MAX_HANDLES &&
+		    ++handle_cnt[event.handle] >= TIPC_DISPATCH_HANDLE_MAX) {
+			busy_end = true;
+			break;
+		}
+	}
+
+	if (cnt) {
+		tipc_dispatch_stats_t *st = &ctx->stats;
+
+		st->wakeups++;
+		st->events += cnt;
+		st->batch_hist[cnt]++;
+		if (busy_end)
+			st->busy_ends++;
+		if (cnt > st->max_batch)
+			st->max_batch = cnt;
+		if (st->wakeups == TIPC_DISPATCH_STATS_INTERVAL)
+			tipc_report_dispatch_stats(ctx);
+	}
+
+	return cnt;
+}
+
+/*
+ *  Handle events until one of handlers sets ctx->stopped
+ */
+int tipc_run_services(struct tipc_srv_ctx *ctx)
+{
+	while (!ctx->stopped) {
+		tipc_dispatch_events(ctx);
+	}
+
+	tipc_report_dispatch_stats(ctx);
+	tipc_report_accept_stats(ctx);
+	return NO_ERROR;
+}
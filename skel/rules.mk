@@ -21,8 +21,13 @@ MODULE_SRCS += \
 	$(LOCAL_DIR)/skel_app.c \
 	$(LOCAL_DIR)/manifest.c
 
+# index into _workloads[] in skel_app.c: cpu
+MODULE_DEFINES += \
+	SKEL_WORKLOAD=0 \
+
 MODULE_DEPS += \
 	app/trusty \
 	lib/libc-trusty \
+	app/sample/lib/perf \
 
 include make/module.mk
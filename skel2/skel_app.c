@@ -20,9 +20,103 @@
 #include <string.h>
 #include <trusty_std.h>
 
+#include <lib/perf/perf_stats.h>
+
+/*
+ * Skeleton app doubling as a workload harness.
+ *
+ * The chosen workload is run SKEL_WARMUP_ITERS times untimed, then
+ * SKEL_ITERS times with every iteration timed on the monotonic clock,
+ * and the result is printed as a "PERF skel <workload>" stats line plus
+ * a throughput line. SKEL_WORKLOAD (set from rules.mk) picks the
+ * workload, so copies of the app built with different values can run
+ * side by side to see how much co-scheduled apps slow each other down.
+ * To add a workload, add its function to _workloads[] below.
+ */
+#ifndef SKEL_WORKLOAD
+#define SKEL_WORKLOAD         0
+#endif
+
+#define SKEL_WARMUP_ITERS     100
+#define SKEL_ITERS            10000
+#define SKEL_OPS_PER_ITER     4096
+#define SKEL_MEM_BUF_SIZE     (64 * 1024)
+#define SKEL_CACHE_LINE       64
+
+struct skel_workload {
+	const char *name;
+	uint32_t (*run)(uint32_t seed);   /* does SKEL_OPS_PER_ITER ops */
+};
+
+static uint8_t _mem_buf[SKEL_MEM_BUF_SIZE];
+
+/* keeps results alive so the compiler cannot drop the work */
+static volatile uint32_t _sink;
+
+static struct perf_stats _stats;
+
+/* register only: xorshift rounds */
+static uint32_t skel_cpu(uint32_t x)
+{
+	x |= 1;
+	for (uint i = 0; i < SKEL_OPS_PER_ITER; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+	}
+	return x;
+}
+
+/* cache bound: read-modify-write one byte per line across the buffer */
+static uint32_t skel_mem(uint32_t x)
+{
+	size_t pos = x % SKEL_CACHE_LINE;
+
+	for (uint i = 0; i < SKEL_OPS_PER_ITER; i++) {
+		_mem_buf[pos] += (uint8_t)i;
+		x += _mem_buf[pos];
+		pos = (pos + SKEL_CACHE_LINE) % SKEL_MEM_BUF_SIZE;
+	}
+	return x;
+}
+
+static const struct skel_workload _workloads[] = {
+	{ "cpu", skel_cpu },
+	{ "mem", skel_mem },
+};
+
 int main(void)
 {
-	printf("Hello world from skeleton app 2\n");
+	uint32_t x = 0x12345678;
+	const struct skel_workload *wl;
+
+	if (SKEL_WORKLOAD >= countof(_workloads)) {
+		printf("skeleton app: no workload %d\n", SKEL_WORKLOAD);
+		return -1;
+	}
+	wl = &_workloads[SKEL_WORKLOAD];
+
+	printf("skeleton app: running %s workload\n", wl->name);
+
+	for (uint i = 0; i < SKEL_WARMUP_ITERS; i++)
+		x = wl->run(x);
+
+	int64_t start = perf_now_ns();
+	for (uint i = 0; i < SKEL_ITERS; i++) {
+		int64_t t0 = perf_now_ns();
+		x = wl->run(x);
+		perf_stats_add(&_stats, perf_now_ns() - t0);
+	}
+	int64_t total = perf_now_ns() - start;
+	_sink = x;
+
+	perf_print_stats("skel", wl->name, &_stats, "ns");
+	if (total > 0) {
+		perf_print_value("skel", wl->name, "ops_per_sec",
+		                 (int64_t)((uint64_t)SKEL_ITERS *
+		                           SKEL_OPS_PER_ITER * 1000000000ULL /
+		                           (uint64_t)total), "ops");
+	}
 
 	return 0;
 }
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <lib/perf/perf_stats.h>
+#include <lib/storage/storage.h>
+#include <lib/storage_ext/storage_stats.h>
+
+#include <trusty_std.h>
+
+#include "bench.h"
+#include "io_arena.h"
+#include "pattern.h"
+
+#define LOG_TAG "ss_bench"
+#define TLOGI(fmt, ...) \
+    fprintf(stderr, "%s: %d: " fmt, LOG_TAG, __LINE__,  ## __VA_ARGS__)
+
+#define BENCH_FILE_SIZE   (2 * IO_ARENA_MAX_CHUNK)
+
+// chunk sizes to sweep
+static const size_t bench_chunks[] = {
+    512, 1024, 2048, 4096, 8192, 16384, 32768, IO_ARENA_MAX_CHUNK,
+};
+
+// number of writes per STORAGE_OP_COMPLETE, 0 - single commit per file
+static const unsigned bench_batches[] = {
+    1, 4, 16, 0,
+};
+
+struct bench_result {
+    int64_t write_ns;
+    int64_t read_ns;
+    struct perf_stats commit;    // latency of committing writes
+};
+
+// KB/s
+static uint64_t kbps(size_t bytes, int64_t ns)
+{
+    return ns > 0 ? (uint64_t)bytes * 1000000000ULL / 1024 / ns : 0;
+}
+
+/*
+ * Write BENCH_FILE_SIZE bytes in chunk sized writes committing every
+ * batch writes, then read it back in chunk sized reads
+ */
+static int bench_rw(storage_session_t ss, size_t chunk, unsigned batch,
+                    struct bench_result *res)
+{
+    int rc;
+    file_handle_t handle;
+    storage_off_t off;
+    unsigned nwrites = 0;
+    uint32_t *buf;
+    const char *fname = "bench_rw";
+
+    memset(res, 0, sizeof(*res));
+
+    rc = storage_stats_open_file(ss, &handle, fname,
+                           STORAGE_FILE_OPEN_CREATE | STORAGE_FILE_OPEN_TRUNCATE,
+                           STORAGE_OP_COMPLETE);
+    if (rc < 0) {
+        TLOGI("failed (%d) to open '%s'\n", rc, fname);
+        return rc;
+    }
+
+    buf = io_arena_get(chunk);
+
+    for (off = 0; off < BENCH_FILE_SIZE; off += chunk) {
+        bool last = (off + chunk >= BENCH_FILE_SIZE);
+        bool commit = last || (batch && (++nwrites % batch) == 0);
+
+        // pattern fill is not part of measured time
+        fill_pattern32(buf, chunk, off);
+
+        int64_t t0 = perf_now_ns();
+        rc = storage_stats_write(handle, off, buf, chunk,
+                           commit ? STORAGE_OP_COMPLETE : 0);
+        int64_t dt = perf_now_ns() - t0;
+        if (rc != (int)chunk) {
+            TLOGI("write at %llu failed (%d)\n", off, rc);
+            rc = rc < 0 ? rc : ERR_IO;
+            goto err_io;
+        }
+
+        res->write_ns += dt;
+        if (commit)
+            perf_stats_add(&res->commit, dt);
+    }
+
+    for (off = 0; off < BENCH_FILE_SIZE; off += chunk) {
+        int64_t t0 = perf_now_ns();
+        rc = storage_stats_read(handle, off, buf, chunk);
+        res->read_ns += perf_now_ns() - t0;
+        if (rc != (int)chunk) {
+            TLOGI("read at %llu failed (%d)\n", off, rc);
+            rc = rc < 0 ? rc : ERR_IO;
+            goto err_io;
+        }
+        size_t bad = find_pattern32_mismatch(buf, chunk, off);
+        if (bad != chunk) {
+            TLOGI("unexpected data at %llu\n", off + bad);
+            rc = ERR_CHECKSUM_FAIL;
+            goto err_io;
+        }
+    }
+    rc = NO_ERROR;
+
+err_io:
+    io_arena_put(buf);
+    storage_stats_close_file(handle);
+    storage_stats_delete_file(ss, fname, STORAGE_OP_COMPLETE);
+    return rc;
+}
+
+static void bench_report(const char *port, size_t chunk, unsigned batch,
+                         const struct bench_result *res)
+{
+    char name[96];
+
+    snprintf(name, sizeof(name), "%s.chunk%zu.batch%u", port, chunk,
+             batch ? batch : (unsigned)(BENCH_FILE_SIZE / chunk));
+    perf_print_value("storage", name, "write",
+                     kbps(BENCH_FILE_SIZE, res->write_ns), "KB/s");
+    perf_print_value("storage", name, "read",
+                     kbps(BENCH_FILE_SIZE, res->read_ns), "KB/s");
+    perf_print_stats("storage", name, &res->commit, "ns");
+}
+
+void run_all_benchmarks(const char *port)
+{
+    int rc;
+    unsigned failed = 0;
+    storage_session_t ss;
+    struct bench_result res;
+
+    rc = storage_stats_open_session(&ss, port);
+    if (rc < 0) {
+        TLOGI("failed (%d) to open session on %s\n", rc, port);
+        return;
+    }
+
+    TLOGI("SS-bench: %s: begins\n", port);
+
+    for (size_t i = 0; i < countof(bench_chunks); i++) {
+        for (size_t j = 0; j < countof(bench_batches); j++) {
+            rc = bench_rw(ss, bench_chunks[i], bench_batches[j], &res);
+            if (rc == NO_ERROR) {
+                bench_report(port, bench_chunks[i], bench_batches[j], &res);
+            } else {
+                failed++;
+            }
+        }
+    }
+
+    storage_stats_dump();
+    storage_stats_close_session(ss);
+    storage_stats_reset();
+
+    TLOGI("SS-bench: %s: ends (%u failed)\n", port, failed);
+}
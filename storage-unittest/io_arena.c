@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <err.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <lib/memprof/memprof.h>
+
+#include "io_arena.h"
+
+static struct {
+    uint32_t *buf;
+    bool busy;
+} io_arena;
+
+int io_arena_init(void)
+{
+    if (io_arena.buf)
+        return NO_ERROR;
+
+    io_arena.buf = memalign(IO_ARENA_ALIGN, IO_ARENA_MAX_CHUNK);
+    if (!io_arena.buf)
+        return ERR_NO_MEMORY;
+
+    io_arena.busy = false;
+    return NO_ERROR;
+}
+
+void io_arena_fini(void)
+{
+    assert(!io_arena.busy);
+    free(io_arena.buf);
+    io_arena.buf = NULL;
+}
+
+uint32_t *io_arena_get(size_t len)
+{
+    assert(io_arena.buf);
+    assert(!io_arena.busy);
+    assert(len <= IO_ARENA_MAX_CHUNK);
+
+    io_arena.busy = true;
+    return io_arena.buf;
+}
+
+void io_arena_put(uint32_t *buf)
+{
+    assert(io_arena.busy && buf == io_arena.buf);
+    io_arena.busy = false;
+}
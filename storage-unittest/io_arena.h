@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest chunk storage test and benchmark helpers may use
+#define IO_ARENA_MAX_CHUNK  (64 * 1024)
+#define IO_ARENA_ALIGN      64   // cache line
+
+/*
+ * Single preallocated I/O buffer shared by storage client helpers.
+ *
+ * Only one chunk is ever in flight, so helpers take the buffer with
+ * io_arena_get() for the duration of a call and give it back with
+ * io_arena_put(). Getting it twice or asking for more than
+ * IO_ARENA_MAX_CHUNK bytes is a bug and asserts.
+ */
+int io_arena_init(void);
+void io_arena_fini(void);
+uint32_t *io_arena_get(size_t len);
+void io_arena_put(uint32_t *buf);
@@ -21,20 +21,37 @@
 #include <malloc.h>
 
 #include <lib/storage/storage.h>
+#include <lib/storage_ext/storage_batch.h>
+#include <lib/storage_ext/storage_readahead.h>
+#include <lib/storage_ext/storage_stream.h>
 
 #include <trusty_unittest.h>
 #include <trusty_std.h>
 
+#include <lib/memprof/memprof.h>
+#include <lib/testreg/testreg.h>
+
+#include "bench.h"
+#include "io_arena.h"
+#include "manifest.h"
+#include "parallel.h"
+#include "pattern.h"
+
 #define LOG_TAG "ss_unittest"
 #define TLOGE(fmt, ...) \
     fprintf(stderr, "%s: %d: " fmt, LOG_TAG, __LINE__,  ## __VA_ARGS__)
 
 typedef void (*test_body)(storage_session_t ss, storage_session_t ss_aux);
 
-void test_wrapper(const char *port, test_body test_proc)
+void test_wrapper(const char *port, const char *name, test_body test_proc)
 {
     storage_session_t ss;
     storage_session_t ss_aux;
+    char suite[TESTREG_SUITE_LEN];
+    const char *kind = strrchr(port, '.');
+
+    // one suite per storage port: storage.td, storage.tp, ...
+    snprintf(suite, sizeof(suite), "storage.%s", kind ? kind + 1 : port);
 
     int rc = storage_open_session(&ss, port);
     if (rc < 0) {
@@ -49,7 +66,11 @@ void test_wrapper(const char *port, test_body test_proc)
         return;
     }
 
+    uint failed = _tests_failed;
+    testreg_begin(suite, name);
     test_proc(ss, ss_aux);
+    testreg_end(_tests_failed == failed);
+
     storage_close_session(ss);
     storage_close_session(ss_aux);
 }
@@ -58,7 +79,7 @@ void test_wrapper(const char *port, test_body test_proc)
 #define TEST_P(name) static void test_##name(storage_session_t ss, storage_session_t ss_aux)
 
 
-#define RUN_TEST_P(port, tn) test_wrapper(port, test_## tn)
+#define RUN_TEST_P(port, tn) test_wrapper(port, #tn, test_## tn)
 
 
 #define ASSERT_ALL_OK()  if (!_all_ok) { goto test_abort; }
@@ -93,65 +114,40 @@ static bool is_valid_offset(storage_off_t off)
     return (off & 0x3) == 0ULL;
 }
 
-static void fill_pattern32(uint32_t *buf, size_t len, storage_off_t off)
-{
-    size_t cnt = len / sizeof(uint32_t);
-    uint32_t pattern = (uint32_t)(off / sizeof(uint32_t));
-    while (cnt--) {
-        *buf++ = pattern++;
-    }
-}
-
-static bool check_pattern32(const uint32_t *buf, size_t len, storage_off_t off)
-{
-    size_t cnt = len / sizeof(uint32_t);
-    uint32_t pattern = (uint32_t)(off / sizeof(uint32_t));
-    while (cnt--) {
-        if (*buf != pattern)
-            return false;
-        buf++;
-        pattern++;
-    }
-    return true;
-}
-
-static bool check_value32(const uint32_t *buf, size_t len, uint32_t val)
-{
-    size_t cnt = len / sizeof(uint32_t);
-    while (cnt--) {
-        if (*buf != val)
-            return false;
-        buf++;
-    }
-    return true;
-}
-
 static int WriteZeroChunk(file_handle_t handle, storage_off_t off,
                           size_t chunk_len, bool complete)
 {
-    uint32_t data_buf[chunk_len/sizeof(uint32_t)];
+    int rc;
+    uint32_t *data_buf;
 
     assert(is_valid_size(chunk_len));
     assert(is_valid_offset(off));
 
+    data_buf = io_arena_get(chunk_len);
     memset(data_buf, 0, chunk_len);
 
-    return storage_write(handle, off, data_buf, sizeof(data_buf),
-                         complete ? STORAGE_OP_COMPLETE : 0);
+    rc = storage_write(handle, off, data_buf, chunk_len,
+                       complete ? STORAGE_OP_COMPLETE : 0);
+    io_arena_put(data_buf);
+    return rc;
 }
 
 static int WritePatternChunk(file_handle_t handle, storage_off_t off,
                              size_t chunk_len, bool complete)
 {
-    uint32_t data_buf[chunk_len/sizeof(uint32_t)];
+    int rc;
+    uint32_t *data_buf;
 
     assert(is_valid_size(chunk_len));
     assert(is_valid_offset(off));
 
+    data_buf = io_arena_get(chunk_len);
     fill_pattern32(data_buf, chunk_len, off);
 
-    return storage_write(handle, off, data_buf, sizeof(data_buf),
-                         complete ? STORAGE_OP_COMPLETE : 0);
+    rc = storage_write(handle, off, data_buf, chunk_len,
+                       complete ? STORAGE_OP_COMPLETE : 0);
+    io_arena_put(data_buf);
+    return rc;
 }
 
 static int WritePattern(file_handle_t handle, storage_off_t off,
@@ -177,23 +173,10 @@ static int WritePattern(file_handle_t handle, storage_off_t off,
     return (int)written;
 }
 
-
-static int ReadChunk(file_handle_t handle,
-                     storage_off_t off, size_t chunk_len,
-                     size_t head_len, size_t pattern_len,
-                     size_t tail_len)
+static int _ReadChunk(const uint32_t *data_buf, storage_off_t off,
+                      size_t head_len, size_t pattern_len, size_t tail_len)
 {
-    int rc;
-    uint32_t data_buf[chunk_len/sizeof(uint32_t)];
-    uint8_t *data_ptr = (uint8_t *)data_buf;
-
-    assert(is_valid_size(chunk_len));
-    assert(is_valid_offset(off));
-    assert((head_len + pattern_len + tail_len) == chunk_len);
-
-    rc = storage_read(handle, off, data_buf, chunk_len);
-    if ((size_t)rc != chunk_len)
-        return rc;
+    const uint8_t *data_ptr = (const uint8_t *)data_buf;
 
     if (head_len) {
         if (!check_value32((const uint32_t *)data_ptr, head_len, 0))
@@ -213,7 +196,32 @@ static int ReadChunk(file_handle_t handle,
             return ERR_CHECKSUM_FAIL;
     }
 
-    return chunk_len;
+    return NO_ERROR;
+}
+
+static int ReadChunk(file_handle_t handle,
+                     storage_off_t off, size_t chunk_len,
+                     size_t head_len, size_t pattern_len,
+                     size_t tail_len)
+{
+    int rc;
+    uint32_t *data_buf;
+
+    assert(is_valid_size(chunk_len));
+    assert(is_valid_offset(off));
+    assert((head_len + pattern_len + tail_len) == chunk_len);
+
+    data_buf = io_arena_get(chunk_len);
+
+    rc = storage_read(handle, off, data_buf, chunk_len);
+    if ((size_t)rc == chunk_len) {
+        int res = _ReadChunk(data_buf, off, head_len, pattern_len, tail_len);
+        if (res != NO_ERROR)
+            rc = res;
+    }
+
+    io_arena_put(data_buf);
+    return rc;
 }
 
 static int ReadPattern(file_handle_t handle, storage_off_t off,
@@ -221,27 +229,40 @@ static int ReadPattern(file_handle_t handle, storage_off_t off,
 {
     int rc;
     size_t bytes_read = 0;
-    uint32_t data_buf[chunk_len/sizeof(uint32_t)];
+    size_t buf_len = chunk_len;
+    uint32_t *data_buf;
 
     assert(is_valid_size(chunk_len));
     assert(is_valid_size(data_len));
     assert(is_valid_offset(off));
 
+    data_buf = io_arena_get(buf_len);
+
     while (data_len) {
         if (chunk_len > data_len)
             chunk_len = data_len;
-        rc = storage_read(handle, off, data_buf, sizeof(data_buf));
+        rc = storage_read(handle, off, data_buf, buf_len);
         if (rc < 0)
-            return rc;
-        if ((size_t)rc != chunk_len)
-            return bytes_read + rc;
-        if (!check_pattern32(data_buf, chunk_len, off))
-            return ERR_CHECKSUM_FAIL;
+            goto done;
+        if ((size_t)rc != chunk_len) {
+            rc = bytes_read + rc;
+            goto done;
+        }
+        size_t bad = find_pattern32_mismatch(data_buf, chunk_len, off);
+        if (bad != chunk_len) {
+            TLOGE("pattern mismatch at offset %llu\n", off + bad);
+            rc = ERR_CHECKSUM_FAIL;
+            goto done;
+        }
         off += chunk_len;
         data_len -= chunk_len;
         bytes_read += chunk_len;
     }
-    return bytes_read;
+    rc = bytes_read;
+
+done:
+    io_arena_put(data_buf);
+    return rc;
 }
 
 static int ReadPatternEOF(file_handle_t handle,
@@ -249,24 +270,36 @@ static int ReadPatternEOF(file_handle_t handle,
 {
     int rc;
     size_t bytes_read = 0;
-    uint32_t data_buf[chunk_len/sizeof(uint32_t)];
+    uint32_t *data_buf;
 
     assert(is_valid_size(chunk_len));
 
+    data_buf = io_arena_get(chunk_len);
+
     while (true) {
-         rc = storage_read(handle, off, data_buf, sizeof(data_buf));
+         rc = storage_read(handle, off, data_buf, chunk_len);
          if (rc < 0)
-             return rc;
+             goto done;
          if (rc == 0)
              break; // end of file reached
-         if (!is_valid_size((size_t)rc))
-             return ERR_BAD_LEN;
-         if (!check_pattern32(data_buf, rc, off))
-             return ERR_CHECKSUM_FAIL;
+         if (!is_valid_size((size_t)rc)) {
+             rc = ERR_BAD_LEN;
+             goto done;
+         }
+         size_t bad = find_pattern32_mismatch(data_buf, rc, off);
+         if (bad != (size_t)rc) {
+             TLOGE("pattern mismatch at offset %llu\n", off + bad);
+             rc = ERR_CHECKSUM_FAIL;
+             goto done;
+         }
          off += rc;
          bytes_read += rc;
     }
-    return bytes_read;
+    rc = bytes_read;
+
+done:
+    io_arena_put(data_buf);
+    return rc;
 }
 
 
@@ -1047,9 +1080,290 @@ test_abort:
     TEST_END;
 }
 
+// three vector steps and a scalar tail
+#define MISMATCH_WORDS  (3 * PATTERN_VEC_WORDS + 5)
+
+// reference for find_pattern32_mismatch: plain word loop
+static size_t ref_pattern_mismatch(const uint32_t *buf, size_t cnt,
+                                   uint64_t off)
+{
+    uint32_t pattern = (uint32_t)(off / sizeof(uint32_t));
+
+    for (size_t i = 0; i < cnt; i++) {
+        if (buf[i] != pattern + (uint32_t)i)
+            return i * sizeof(uint32_t);
+    }
+    return cnt * sizeof(uint32_t);
+}
+
+TEST_P(PatternMismatchOffsets)
+{
+    static uint32_t buf[MISMATCH_WORDS];
+    const size_t len = sizeof(buf);
+    const uint64_t offs[] = { 0, 13 * sizeof(uint32_t) };
+    // word 0, both sides of every vector step boundary, tail, last word
+    const size_t bad_words[] = {
+        0,
+        PATTERN_VEC_WORDS - 1, PATTERN_VEC_WORDS,
+        2 * PATTERN_VEC_WORDS - 1, 2 * PATTERN_VEC_WORDS,
+        3 * PATTERN_VEC_WORDS - 1, 3 * PATTERN_VEC_WORDS,
+        MISMATCH_WORDS - 1,
+    };
+
+    TEST_BEGIN(__func__);
+
+    for (size_t o = 0; o < countof(offs); o++) {
+        fill_pattern32(buf, len, offs[o]);
+        ASSERT_EQ(len, ref_pattern_mismatch(buf, MISMATCH_WORDS, offs[o]));
+        ASSERT_EQ(len, find_pattern32_mismatch(buf, len, offs[o]));
+
+        // bytes that do not make a whole word are ignored
+        buf[MISMATCH_WORDS - 1] ^= 0x100;
+        ASSERT_EQ(len - 2, find_pattern32_mismatch(buf, len - 2, offs[o]));
+        buf[MISMATCH_WORDS - 1] ^= 0x100;
+
+        for (size_t b = 0; b < countof(bad_words); b++) {
+            size_t w = bad_words[b];
+
+            buf[w] ^= 0x100;
+            size_t exp = ref_pattern_mismatch(buf, MISMATCH_WORDS, offs[o]);
+            ASSERT_EQ(w * sizeof(uint32_t), exp);
+            ASSERT_EQ(exp, find_pattern32_mismatch(buf, len, offs[o]));
+            buf[w] ^= 0x100;
+        }
+    }
+
+    for (size_t b = 0; b < countof(bad_words); b++) {
+        size_t w = bad_words[b];
+
+        for (size_t i = 0; i < MISMATCH_WORDS; i++)
+            buf[i] = 0xdeadbeef;
+        ASSERT_EQ(len, find_value32_mismatch(buf, len, 0xdeadbeef));
+
+        buf[w] = 0xdeadbeee;
+        ASSERT_EQ(w * sizeof(uint32_t),
+                  find_value32_mismatch(buf, len, 0xdeadbeef));
+    }
+
+    // two bad words report the first one
+    fill_pattern32(buf, len, 0);
+    buf[PATTERN_VEC_WORDS + 1] = 0;
+    buf[PATTERN_VEC_WORDS + 3] = 0;
+    ASSERT_EQ((PATTERN_VEC_WORDS + 1) * sizeof(uint32_t),
+              find_pattern32_mismatch(buf, len, 0));
+
+test_abort:
+    TEST_END;
+}
+
 
 // Negative tests
 
+#define RA_WINDOW  8192
+
+static uint8_t ra_window[RA_WINDOW];
+
+static int ReadPatternRA(struct storage_ra *ra, storage_off_t off,
+                         size_t data_len, size_t chunk_len)
+{
+    int rc;
+    size_t bytes_read = 0;
+    uint32_t *data_buf;
+
+    assert(is_valid_size(chunk_len));
+
+    data_buf = io_arena_get(chunk_len);
+
+    while (data_len) {
+        if (chunk_len > data_len)
+            chunk_len = data_len;
+        rc = storage_ra_read(ra, off, data_buf, chunk_len);
+        if (rc < 0)
+            goto done;
+        if ((size_t)rc != chunk_len) {
+            rc = bytes_read + rc;
+            goto done;
+        }
+        if (!check_pattern32(data_buf, chunk_len, off)) {
+            rc = ERR_CHECKSUM_FAIL;
+            goto done;
+        }
+        off += chunk_len;
+        data_len -= chunk_len;
+        bytes_read += chunk_len;
+    }
+    rc = bytes_read;
+
+done:
+    io_arena_put(data_buf);
+    return rc;
+}
+
+TEST_P(ReadAheadSequential)
+{
+    int rc;
+    file_handle_t handle;
+    struct storage_ra ra = { .node = LIST_INITIAL_CLEARED_VALUE };
+    size_t blk = 512;
+    // not a window multiple: last window is short and marks EOF
+    size_t exp_len = 4 * RA_WINDOW + 2048;
+    uint32_t val = 0xDEADBEEF;
+    unsigned fills;
+    const char *fname = "test_read_ahead_sequential";
+
+    TEST_BEGIN(__func__);
+
+    // open create truncate file (with commit)
+    rc = storage_open_file(ss, &handle, fname,
+                           STORAGE_FILE_OPEN_CREATE | STORAGE_FILE_OPEN_TRUNCATE,
+                           STORAGE_OP_COMPLETE);
+    ASSERT_EQ(0, rc);
+
+    // write a bunch of blocks (with commit)
+    rc = WritePattern(handle, 0, exp_len, 2048, true);
+    ASSERT_EQ((int)exp_len, rc);
+
+    storage_ra_init(&ra, ss, handle, ra_window, sizeof(ra_window));
+
+    // small sequential reads should take one round trip per window
+    rc = ReadPatternRA(&ra, 0, exp_len, blk);
+    ASSERT_EQ((int)exp_len, rc);
+    fills = (exp_len + RA_WINDOW - 1) / RA_WINDOW;
+    ASSERT_EQ(fills, ra.fills);
+
+    // then hit EOF without going to storage
+    rc = storage_ra_read(&ra, exp_len, &val, sizeof(val));
+    ASSERT_EQ(0, rc);
+    ASSERT_EQ(fills, ra.fills);
+
+    // write (without commit) through cache drops cached window
+    rc = storage_ra_write(&ra, 0, &val, sizeof(val), 0);
+    ASSERT_EQ((int)sizeof(val), rc);
+
+    val = 0;
+    rc = storage_ra_read(&ra, 0, &val, sizeof(val));
+    ASSERT_EQ((int)sizeof(val), rc);
+    ASSERT_EQ(0xDEADBEEF, val);
+
+    // abort current transaction: pattern is back
+    rc = storage_ra_end_transaction(ss, false);
+    ASSERT_EQ(0, rc);
+
+    rc = ReadPatternRA(&ra, 0, blk, blk);
+    ASSERT_EQ((int)blk, rc);
+
+    // truncate file (with commit): cached tail must be gone
+    rc = storage_ra_set_file_size(&ra, exp_len / 2, STORAGE_OP_COMPLETE);
+    ASSERT_EQ(0, rc);
+
+    rc = storage_ra_read(&ra, exp_len / 2, &val, sizeof(val));
+    ASSERT_EQ(0, rc);
+
+    rc = ReadPatternRA(&ra, 0, exp_len / 2, blk);
+    ASSERT_EQ((int)exp_len / 2, rc);
+
+    // cleanup
+    storage_close_file(handle);
+    storage_delete_file(ss, fname, STORAGE_OP_COMPLETE);
+
+test_abort:
+    storage_ra_fini(&ra);
+    TEST_END;
+}
+
+#define STREAM_BLOCK       4096
+#define STREAM_PIECE       1028      // not a divisor of block on purpose
+#define STREAM_CHECKPOINT  (256 * 1024)
+#define STREAM_FILE_SIZE   (2 * 1024 * 1024)
+
+static uint8_t stream_block[STREAM_BLOCK];
+static uint32_t stream_piece[STREAM_PIECE / sizeof(uint32_t)];
+
+/*
+ * Feed len bytes of test pattern starting at off to stream in
+ * STREAM_PIECE sized pieces
+ */
+static int StreamPattern(struct storage_stream *st, storage_off_t off,
+                         size_t len)
+{
+    while (len) {
+        size_t n = MIN(len, sizeof(stream_piece));
+        fill_pattern32(stream_piece, n, off);
+        ssize_t rc = storage_stream_write(st, stream_piece, n);
+        if (rc < 0)
+            return rc;
+        off += n;
+        len -= n;
+    }
+    return NO_ERROR;
+}
+
+TEST_P(StreamWriteLarge)
+{
+    int rc;
+    int64_t end;
+    file_handle_t handle;
+    file_handle_t handle_aux;
+    struct storage_stream st;
+    size_t blk = 2048;
+    size_t part_len = STREAM_CHECKPOINT + STREAM_CHECKPOINT / 2;
+    storage_off_t fsize = (storage_off_t)(-1);
+    const char *fname = "test_stream_write_large";
+
+    TEST_BEGIN(__func__);
+
+    // open create truncate file (with commit)
+    rc = storage_open_file(ss, &handle, fname,
+                           STORAGE_FILE_OPEN_CREATE | STORAGE_FILE_OPEN_TRUNCATE,
+                           STORAGE_OP_COMPLETE);
+    ASSERT_EQ(0, rc);
+
+    // stream past first checkpoint then discard transaction
+    storage_stream_init(&st, ss, handle, 0, stream_block, sizeof(stream_block),
+                        STREAM_CHECKPOINT);
+    rc = StreamPattern(&st, 0, part_len);
+    ASSERT_EQ(0, rc);
+    ASSERT_EQ(1U, st.commits);
+
+    rc = storage_end_transaction(ss, false);
+    ASSERT_EQ(0, rc);
+
+    // only data up to checkpoint survives
+    rc = storage_get_file_size(handle, &fsize);
+    ASSERT_EQ(0, rc);
+    ASSERT_EQ((storage_off_t)STREAM_CHECKPOINT, fsize);
+
+    // now stream the whole file
+    storage_stream_init(&st, ss, handle, 0, stream_block, sizeof(stream_block),
+                        STREAM_CHECKPOINT);
+    rc = StreamPattern(&st, 0, STREAM_FILE_SIZE);
+    ASSERT_EQ(0, rc);
+
+    end = storage_stream_close(&st, true);
+    ASSERT_EQ((int64_t)STREAM_FILE_SIZE, end);
+    ASSERT_EQ((unsigned)(STREAM_FILE_SIZE / STREAM_BLOCK), st.writes);
+    ASSERT_EQ((unsigned)(STREAM_FILE_SIZE / STREAM_CHECKPOINT), st.commits);
+
+    // check size and data from aux session: all of it is committed
+    rc = storage_open_file(ss_aux, &handle_aux, fname, 0, 0);
+    ASSERT_EQ(0, rc);
+
+    rc = storage_get_file_size(handle_aux, &fsize);
+    ASSERT_EQ(0, rc);
+    ASSERT_EQ((storage_off_t)STREAM_FILE_SIZE, fsize);
+
+    rc = ReadPatternEOF(handle_aux, 0, blk);
+    ASSERT_EQ((int)STREAM_FILE_SIZE, rc);
+
+    // cleanup
+    storage_close_file(handle_aux);
+    storage_close_file(handle);
+    storage_delete_file(ss, fname, STORAGE_OP_COMPLETE);
+
+test_abort:
+    TEST_END;
+}
+
 TEST_P(OpenInvalidFileName)
 {
     int rc;
@@ -2383,6 +2697,167 @@ test_abort:
     TEST_END;
 }
 
+#define BATCH_REC_SIZE  128
+#define BATCH_REC_CNT   STORAGE_BATCH_MAX_EXTENTS
+
+// batch and record buffers must outlive queued extents and are too big for stack
+static struct storage_batch test_batch;
+static uint32_t batch_recs[BATCH_REC_SIZE * BATCH_REC_CNT / sizeof(uint32_t)];
+
+TEST_P(TransactCommitBatchWrites)
+{
+    int rc;
+    ssize_t wr;
+    file_handle_t handle1;
+    file_handle_t handle2;
+    file_handle_t handle1_aux;
+    size_t blk = 2048;
+    size_t exp_len = sizeof(batch_recs);
+    storage_off_t fsize = (storage_off_t)(-1);
+    const char *fname1 = "test_transact_commit_batch_file1";
+    const char *fname2 = "test_transact_commit_batch_file2";
+
+    TEST_BEGIN(__func__);
+
+    // open create truncate both files (with commit)
+    rc = storage_open_file(ss, &handle1, fname1,
+                           STORAGE_FILE_OPEN_CREATE | STORAGE_FILE_OPEN_TRUNCATE,
+                           STORAGE_OP_COMPLETE);
+    ASSERT_EQ(0, rc);
+
+    rc = storage_open_file(ss, &handle2, fname2,
+                           STORAGE_FILE_OPEN_CREATE | STORAGE_FILE_OPEN_TRUNCATE,
+                           STORAGE_OP_COMPLETE);
+    ASSERT_EQ(0, rc);
+
+    rc = storage_open_file(ss_aux, &handle1_aux, fname1, 0, 0);
+    ASSERT_EQ(0, rc);
+
+    fill_pattern32(batch_recs, exp_len, 0);
+    storage_batch_init(&test_batch, ss);
+
+    // queue back to back records of file1: should go out as one write
+    for (uint i = 0; i < BATCH_REC_CNT; i++) {
+        rc = storage_batch_add_write(&test_batch, handle1,
+                                     i * BATCH_REC_SIZE,
+                                     (uint8_t *)batch_recs + i * BATCH_REC_SIZE,
+                                     BATCH_REC_SIZE);
+        ASSERT_EQ(0, rc);
+    }
+
+    // batch is full now
+    rc = storage_batch_add_write(&test_batch, handle1, exp_len,
+                                 batch_recs, BATCH_REC_SIZE);
+    ASSERT_EQ(ERR_NO_RESOURCES, rc);
+
+    // send it without commit
+    wr = storage_batch_submit(&test_batch, false);
+    ASSERT_EQ((ssize_t)exp_len, wr);
+    ASSERT_EQ(1U, test_batch.writes);
+
+    // queue records of file2 in reverse order: nothing to coalesce
+    for (uint i = BATCH_REC_CNT; i > 0; i--) {
+        rc = storage_batch_add_write(&test_batch, handle2,
+                                     (i - 1) * BATCH_REC_SIZE,
+                                     (uint8_t *)batch_recs + (i - 1) * BATCH_REC_SIZE,
+                                     BATCH_REC_SIZE);
+        ASSERT_EQ(0, rc);
+    }
+
+    // nothing is visible in aux session yet
+    rc = storage_get_file_size(handle1_aux, &fsize);
+    ASSERT_EQ(0, rc);
+    ASSERT_EQ((storage_off_t)0, fsize);
+
+    // send it with commit
+    wr = storage_batch_submit(&test_batch, true);
+    ASSERT_EQ((ssize_t)exp_len, wr);
+    ASSERT_EQ((unsigned)BATCH_REC_CNT, test_batch.writes);
+
+    // both files are committed
+    rc = storage_get_file_size(handle1_aux, &fsize);
+    ASSERT_EQ(0, rc);
+    ASSERT_EQ((storage_off_t)exp_len, fsize);
+
+    rc = ReadPattern(handle1_aux, 0, exp_len, blk);
+    ASSERT_EQ((int)exp_len, rc);
+
+    rc = ReadPattern(handle2, 0, exp_len, blk);
+    ASSERT_EQ((int)exp_len, rc);
+
+    // empty commit is fine
+    wr = storage_batch_submit(&test_batch, true);
+    ASSERT_EQ((ssize_t)0, wr);
+
+    // cleanup
+    storage_close_file(handle1);
+    storage_close_file(handle2);
+    storage_close_file(handle1_aux);
+    storage_delete_file(ss, fname1, STORAGE_OP_COMPLETE);
+    storage_delete_file(ss, fname2, STORAGE_OP_COMPLETE);
+
+test_abort:
+    TEST_END;
+}
+
+TEST_P(TransactDiscardBatchWrites)
+{
+    int rc;
+    ssize_t wr;
+    file_handle_t handle;
+    storage_off_t fsize = (storage_off_t)(-1);
+    const char *fname = "test_transact_discard_batch";
+
+    TEST_BEGIN(__func__);
+
+    rc = storage_open_file(ss, &handle, fname,
+                           STORAGE_FILE_OPEN_CREATE | STORAGE_FILE_OPEN_TRUNCATE,
+                           STORAGE_OP_COMPLETE);
+    ASSERT_EQ(0, rc);
+
+    fill_pattern32(batch_recs, sizeof(batch_recs), 0);
+    storage_batch_init(&test_batch, ss);
+
+    for (uint i = 0; i < 4; i++) {
+        rc = storage_batch_add_write(&test_batch, handle,
+                                     i * BATCH_REC_SIZE,
+                                     (uint8_t *)batch_recs + i * BATCH_REC_SIZE,
+                                     BATCH_REC_SIZE);
+        ASSERT_EQ(0, rc);
+    }
+
+    // send without commit then discard transaction
+    wr = storage_batch_submit(&test_batch, false);
+    ASSERT_EQ((ssize_t)(4 * BATCH_REC_SIZE), wr);
+
+    rc = storage_end_transaction(ss, false);
+    ASSERT_EQ(0, rc);
+
+    rc = storage_get_file_size(handle, &fsize);
+    ASSERT_EQ(0, rc);
+    ASSERT_EQ((storage_off_t)0, fsize);
+
+    // queued but not submitted extents are just dropped
+    rc = storage_batch_add_write(&test_batch, handle, 0,
+                                 batch_recs, BATCH_REC_SIZE);
+    ASSERT_EQ(0, rc);
+    storage_batch_discard(&test_batch);
+
+    wr = storage_batch_submit(&test_batch, true);
+    ASSERT_EQ((ssize_t)0, wr);
+
+    rc = storage_get_file_size(handle, &fsize);
+    ASSERT_EQ(0, rc);
+    ASSERT_EQ((storage_off_t)0, fsize);
+
+    // cleanup
+    storage_close_file(handle);
+    storage_delete_file(ss, fname, STORAGE_OP_COMPLETE);
+
+test_abort:
+    TEST_END;
+}
+
 TEST_P(TransactCommitDeleteCreate)
 {
     int rc;
@@ -2699,6 +3174,9 @@ void run_all_tests(const char *port)
     RUN_TEST_P(port, ReadPersistent32k);
     RUN_TEST_P(port, CleanUpPersistent32K);
     RUN_TEST_P(port, WriteReadLong);
+    RUN_TEST_P(port, PatternMismatchOffsets);
+    RUN_TEST_P(port, ReadAheadSequential);
+    RUN_TEST_P(port, StreamWriteLarge);
     RUN_TEST_P(port, OpenInvalidFileName);
     RUN_TEST_P(port, BadFileHandle);
     RUN_TEST_P(port, ClosedFileHandle);
@@ -2723,6 +3201,8 @@ void run_all_tests(const char *port)
     RUN_TEST_P(port, TransactCommitCreate);
     RUN_TEST_P(port, TransactCommitCreateMany);
     RUN_TEST_P(port, TransactCommitWriteMany);
+    RUN_TEST_P(port, TransactCommitBatchWrites);
+    RUN_TEST_P(port, TransactDiscardBatchWrites);
     RUN_TEST_P(port, TransactCommitDeleteCreate);
     RUN_TEST_P(port, TransactRewriteExistingTruncate);
     RUN_TEST_P(port, TransactRewriteExistingSetSize);
@@ -2733,9 +3213,32 @@ void run_all_tests(const char *port)
 
 int main(void)
 {
+    MEMPROF_INIT(APP_MIN_STACK_SIZE);
+
+    int rc = io_arena_init();
+    if (rc < 0) {
+        TLOGE("failed (%d) to allocate I/O buffer\n", rc);
+        return rc;
+    }
+
     TLOGI("SS-unittest: running all\n");
     run_all_tests(STORAGE_CLIENT_TD_PORT);
 //  run_all_tests(STORAGE_CLIENT_TDEA_PORT);
     run_all_tests(STORAGE_CLIENT_TP_PORT);
-    TLOGI("SS-unittest: complete!");}
+#ifdef WITH_STORAGE_BENCHMARK
+    run_all_benchmarks(STORAGE_CLIENT_TD_PORT);
+    run_all_benchmarks(STORAGE_CLIENT_TP_PORT);
+    run_parallel_sessions();
+#endif
+    io_arena_fini();
+    MEMPROF_REPORT("storage-unittest", APP_MIN_HEAP_SIZE, APP_MIN_STACK_SIZE);
+    TLOGI("SS-unittest: complete!");
+#ifdef WITH_TESTREG
+    // blocks until ipc-unittest collects test timings
+    rc = testreg_publish();
+    if (rc < 0)
+        TLOGE("failed (%d) to publish test records\n", rc);
+#endif
+    return 0;
+}
 
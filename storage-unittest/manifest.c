@@ -18,6 +18,8 @@
 #include <stddef.h>
 #include <stdio.h>
 
+#include "manifest.h"
+
 trusty_app_manifest_t TRUSTY_APP_MANIFEST_ATTRS trusty_app_manifest =
 {
 	.uuid = STORAGE_UNITTEST_APP_UUID,
@@ -25,11 +27,11 @@ trusty_app_manifest_t TRUSTY_APP_MANIFEST_ATTRS trusty_app_manifest =
 	/* optional configuration options here */
 	.config_options =
 	{
-		/* 16 pages for heap */
-		TRUSTY_APP_CONFIG_MIN_HEAP_SIZE(16 * 4096),
+		/* 32 pages for heap: I/O arena plus test buffers */
+		TRUSTY_APP_CONFIG_MIN_HEAP_SIZE(APP_MIN_HEAP_SIZE),
 
 		/* 2 pages for stack */
-		TRUSTY_APP_CONFIG_MIN_STACK_SIZE(2 * 4096),
+		TRUSTY_APP_CONFIG_MIN_STACK_SIZE(APP_MIN_STACK_SIZE),
 	},
 };
 
@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <lib/perf/perf_stats.h>
+#include <lib/storage/storage.h>
+
+#include <trusty_std.h>
+
+#include "io_arena.h"
+#include "parallel.h"
+#include "pattern.h"
+
+#define LOG_TAG "ss_parallel"
+#define TLOGI(fmt, ...) \
+    fprintf(stderr, "%s: %d: " fmt, LOG_TAG, __LINE__,  ## __VA_ARGS__)
+
+/*
+ * Tasks are single threaded, so "at the same time" means every worker
+ * owns a session with its own open transaction and the runner steps all
+ * of them round robin, one storage call each. That keeps N transactions
+ * in flight against the storage server just like N TAs would.
+ */
+#define PAR_MAX_WORKERS     8
+#define PAR_TX_CNT         32     // transactions per worker
+#define PAR_WRITES_PER_TX   4
+#define PAR_CHUNK        1024
+#define PAR_FILE_SIZE   (16 * 1024)  // own file wraps around at this size
+
+// what a commit that lost against another session's transaction returns
+#define PAR_ERR_CONFLICT  ERR_BUSY
+
+static const char *par_ports[] = {
+    STORAGE_CLIENT_TD_PORT,
+    STORAGE_CLIENT_TDEA_PORT,
+    STORAGE_CLIENT_TP_PORT,
+};
+
+static const unsigned par_worker_cnts[] = { 1, 2, 4, PAR_MAX_WORKERS };
+
+struct par_worker {
+    const char *port;
+    storage_session_t ss;
+    file_handle_t own;
+    file_handle_t shared;
+    char fname[32];
+    unsigned step;           // writes done in current transaction
+    unsigned tx_done;
+    unsigned commits;
+    unsigned conflicts;
+    uint64_t bytes;          // written by committed transactions
+    uint64_t tx_bytes;       // written by current transaction
+    bool active;
+};
+
+static struct par_worker workers[PAR_MAX_WORKERS];
+
+static void par_worker_close(struct par_worker *w, bool shared)
+{
+    if (!w->active)
+        return;
+
+    storage_close_file(w->own);
+    storage_delete_file(w->ss, w->fname, STORAGE_OP_COMPLETE);
+    if (shared)
+        storage_close_file(w->shared);
+    storage_close_session(w->ss);
+    w->active = false;
+}
+
+static int par_worker_open(struct par_worker *w, unsigned idx, bool shared)
+{
+    int rc;
+
+    memset(w, 0, sizeof(*w));
+    w->port = par_ports[idx % countof(par_ports)];
+    snprintf(w->fname, sizeof(w->fname), "par_worker_%u", idx);
+
+    rc = storage_open_session(&w->ss, w->port);
+    if (rc < 0)
+        return rc;
+
+    // every worker has a file of its own
+    rc = storage_open_file(w->ss, &w->own, w->fname,
+                           STORAGE_FILE_OPEN_CREATE | STORAGE_FILE_OPEN_TRUNCATE,
+                           STORAGE_OP_COMPLETE);
+    if (rc < 0)
+        goto err_open_own;
+
+    // and optionally updates a slot in a file common to all workers
+    if (shared) {
+        rc = storage_open_file(w->ss, &w->shared, "par_shared",
+                               STORAGE_FILE_OPEN_CREATE, STORAGE_OP_COMPLETE);
+        if (rc < 0)
+            goto err_open_shared;
+    }
+
+    w->active = true;
+    return NO_ERROR;
+
+err_open_shared:
+    storage_close_file(w->own);
+    storage_delete_file(w->ss, w->fname, STORAGE_OP_COMPLETE);
+err_open_own:
+    storage_close_session(w->ss);
+    return rc;
+}
+
+/*
+ * Do one storage call on behalf of worker. The last write of every
+ * transaction carries STORAGE_OP_COMPLETE; in shared mode that is the
+ * write of the worker's slot in the shared file, the only write that can
+ * lose a conflict. Any other failure ends the run.
+ */
+static int par_worker_step(struct par_worker *w, unsigned idx, bool shared,
+                           const void *buf)
+{
+    ssize_t rc;
+    bool last = (w->step == PAR_WRITES_PER_TX - 1);
+    uint32_t opflags = (last && !shared) ? STORAGE_OP_COMPLETE : 0;
+    storage_off_t off = ((w->tx_done * PAR_WRITES_PER_TX + w->step) *
+                         (storage_off_t)PAR_CHUNK) % PAR_FILE_SIZE;
+
+    rc = storage_write(w->own, off, buf, PAR_CHUNK, opflags);
+    if (rc != PAR_CHUNK)
+        goto err_write;
+    w->tx_bytes += PAR_CHUNK;
+
+    if (last && shared) {
+        uint32_t val = w->tx_done;
+        rc = storage_write(w->shared, idx * sizeof(val), &val, sizeof(val),
+                           STORAGE_OP_COMPLETE);
+        if (rc == PAR_ERR_CONFLICT) {
+            // commit lost against another session: drop and go on
+            w->conflicts++;
+            w->tx_bytes = 0;
+            storage_end_transaction(w->ss, false);
+            goto next;
+        }
+        if (rc != sizeof(val))
+            goto err_write;
+    }
+
+    if (last) {
+        w->commits++;
+        w->bytes += w->tx_bytes;
+        w->tx_bytes = 0;
+    }
+
+next:
+    if (last) {
+        w->step = 0;
+        w->tx_done++;
+    } else {
+        w->step++;
+    }
+    return NO_ERROR;
+
+err_write:
+    TLOGI("worker %u: write failed (%d)\n", idx, (int)rc);
+    return rc < 0 ? (int)rc : ERR_IO;
+}
+
+static int run_parallel(unsigned cnt, bool shared, uint32_t *buf)
+{
+    int rc = NO_ERROR;
+    unsigned opened = 0;
+    unsigned running;
+    unsigned per_port[countof(par_ports)] = { 0 };
+    int64_t t0, elapsed;
+
+    for (unsigned i = 0; i < cnt; i++) {
+        rc = par_worker_open(&workers[i], i, shared);
+        if (rc < 0) {
+            // TDEA is not available on every device
+            TLOGI("worker %u: failed (%d) to open on %s - skipped\n",
+                  i, rc, par_ports[i % countof(par_ports)]);
+            continue;
+        }
+        per_port[i % countof(par_ports)]++;
+        opened++;
+    }
+    if (!opened)
+        return ERR_NOT_FOUND;
+
+    t0 = perf_now_ns();
+    do {
+        running = 0;
+        for (unsigned i = 0; i < cnt; i++) {
+            struct par_worker *w = &workers[i];
+
+            if (!w->active || w->tx_done == PAR_TX_CNT)
+                continue;
+            rc = par_worker_step(w, i, shared, buf);
+            if (rc < 0)
+                goto err_step;
+            running++;
+        }
+    } while (running);
+    elapsed = perf_now_ns() - t0;
+
+    uint64_t bytes = 0;
+    unsigned commits = 0;
+    unsigned conflicts = 0;
+    for (unsigned i = 0; i < cnt; i++) {
+        bytes += workers[i].bytes;
+        commits += workers[i].commits;
+        conflicts += workers[i].conflicts;
+    }
+
+    char name[48];
+    snprintf(name, sizeof(name), "parallel.%s.workers%u.td%u.tdea%u.tp%u",
+             shared ? "shared" : "private", opened,
+             per_port[0], per_port[1], per_port[2]);
+    perf_print_value("storage", name, "bw",
+                     elapsed > 0 ? bytes * 1000000000ULL / 1024 / elapsed : 0,
+                     "KB/s");
+    perf_print_value("storage", name, "commits", commits, "tx");
+    perf_print_value("storage", name, "conflicts",
+                     (commits + conflicts) ?
+                     conflicts * 1000 / (commits + conflicts) : 0,
+                     "permille");
+    rc = NO_ERROR;
+
+err_step:
+    for (unsigned i = 0; i < cnt; i++)
+        par_worker_close(&workers[i], shared);
+    return rc;
+}
+
+void run_parallel_sessions(void)
+{
+    unsigned failed = 0;
+    uint32_t *buf = io_arena_get(PAR_CHUNK);
+
+    fill_pattern32(buf, PAR_CHUNK, 0);
+
+    TLOGI("SS-parallel: begins\n");
+
+    for (unsigned i = 0; i < countof(par_worker_cnts); i++) {
+        if (run_parallel(par_worker_cnts[i], false, buf) != NO_ERROR)
+            failed++;
+        if (run_parallel(par_worker_cnts[i], true, buf) != NO_ERROR)
+            failed++;
+    }
+
+    // shared file has to be deleted from every file system
+    for (unsigned i = 0; i < countof(par_ports); i++) {
+        storage_session_t ss;
+        if (storage_open_session(&ss, par_ports[i]) >= 0) {
+            storage_delete_file(ss, "par_shared", STORAGE_OP_COMPLETE);
+            storage_close_session(ss);
+        }
+    }
+
+    io_arena_put(buf);
+
+    TLOGI("SS-parallel: ends (%u failed)\n", failed);
+}
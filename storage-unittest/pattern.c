@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pattern.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PATTERN_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PATTERN_SSE2 1
+#endif
+
+// words handled per vector step: two 128-bit vectors
+#define VEC_WORDS PATTERN_VEC_WORDS
+
+/*
+ * Scalar kernels: also used for tails and to locate the exact word once
+ * a vector step reports a mismatch
+ */
+static void fill_words(uint32_t *buf, size_t cnt, uint32_t pattern)
+{
+    while (cnt--) {
+        *buf++ = pattern++;
+    }
+}
+
+static size_t find_pattern_words(const uint32_t *buf, size_t cnt,
+                                 uint32_t pattern)
+{
+    for (size_t i = 0; i < cnt; i++) {
+        if (buf[i] != pattern + (uint32_t)i)
+            return i;
+    }
+    return cnt;
+}
+
+static size_t find_value_words(const uint32_t *buf, size_t cnt, uint32_t val)
+{
+    for (size_t i = 0; i < cnt; i++) {
+        if (buf[i] != val)
+            return i;
+    }
+    return cnt;
+}
+
+#if PATTERN_NEON
+
+static inline bool all_set(uint32x4_t v)
+{
+#if defined(__aarch64__)
+    return vminvq_u32(v) == UINT32_MAX;
+#else
+    uint32x2_t m = vand_u32(vget_low_u32(v), vget_high_u32(v));
+    return vget_lane_u64(vreinterpret_u64_u32(m), 0) == UINT64_MAX;
+#endif
+}
+
+static size_t fill_vec(uint32_t *buf, size_t cnt, uint32_t pattern)
+{
+    const uint32_t init[4] = { pattern, pattern + 1, pattern + 2, pattern + 3 };
+    const uint32x4_t step = vdupq_n_u32(4);
+    uint32x4_t v0 = vld1q_u32(init);
+    uint32x4_t v1 = vaddq_u32(v0, step);
+    const uint32x4_t step2 = vdupq_n_u32(VEC_WORDS);
+    size_t i;
+
+    for (i = 0; i + VEC_WORDS <= cnt; i += VEC_WORDS) {
+        vst1q_u32(buf + i, v0);
+        vst1q_u32(buf + i + 4, v1);
+        v0 = vaddq_u32(v0, step2);
+        v1 = vaddq_u32(v1, step2);
+    }
+    return i;
+}
+
+static size_t find_pattern_vec(const uint32_t *buf, size_t cnt,
+                               uint32_t pattern)
+{
+    const uint32_t init[4] = { pattern, pattern + 1, pattern + 2, pattern + 3 };
+    uint32x4_t v0 = vld1q_u32(init);
+    uint32x4_t v1 = vaddq_u32(v0, vdupq_n_u32(4));
+    const uint32x4_t step2 = vdupq_n_u32(VEC_WORDS);
+    size_t i;
+
+    for (i = 0; i + VEC_WORDS <= cnt; i += VEC_WORDS) {
+        uint32x4_t eq = vandq_u32(vceqq_u32(vld1q_u32(buf + i), v0),
+                                  vceqq_u32(vld1q_u32(buf + i + 4), v1));
+        if (!all_set(eq))
+            break;
+        v0 = vaddq_u32(v0, step2);
+        v1 = vaddq_u32(v1, step2);
+    }
+    return i;
+}
+
+static size_t find_value_vec(const uint32_t *buf, size_t cnt, uint32_t val)
+{
+    const uint32x4_t v = vdupq_n_u32(val);
+    size_t i;
+
+    for (i = 0; i + VEC_WORDS <= cnt; i += VEC_WORDS) {
+        uint32x4_t eq = vandq_u32(vceqq_u32(vld1q_u32(buf + i), v),
+                                  vceqq_u32(vld1q_u32(buf + i + 4), v));
+        if (!all_set(eq))
+            break;
+    }
+    return i;
+}
+
+#elif PATTERN_SSE2
+
+static size_t fill_vec(uint32_t *buf, size_t cnt, uint32_t pattern)
+{
+    __m128i v0 = _mm_setr_epi32(pattern, pattern + 1, pattern + 2, pattern + 3);
+    __m128i v1 = _mm_add_epi32(v0, _mm_set1_epi32(4));
+    const __m128i step2 = _mm_set1_epi32(VEC_WORDS);
+    size_t i;
+
+    for (i = 0; i + VEC_WORDS <= cnt; i += VEC_WORDS) {
+        _mm_storeu_si128((__m128i *)(buf + i), v0);
+        _mm_storeu_si128((__m128i *)(buf + i + 4), v1);
+        v0 = _mm_add_epi32(v0, step2);
+        v1 = _mm_add_epi32(v1, step2);
+    }
+    return i;
+}
+
+static size_t find_pattern_vec(const uint32_t *buf, size_t cnt,
+                               uint32_t pattern)
+{
+    __m128i v0 = _mm_setr_epi32(pattern, pattern + 1, pattern + 2, pattern + 3);
+    __m128i v1 = _mm_add_epi32(v0, _mm_set1_epi32(4));
+    const __m128i step2 = _mm_set1_epi32(VEC_WORDS);
+    size_t i;
+
+    for (i = 0; i + VEC_WORDS <= cnt; i += VEC_WORDS) {
+        __m128i eq = _mm_and_si128(
+            _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(buf + i)), v0),
+            _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(buf + i + 4)), v1));
+        if (_mm_movemask_epi8(eq) != 0xFFFF)
+            break;
+        v0 = _mm_add_epi32(v0, step2);
+        v1 = _mm_add_epi32(v1, step2);
+    }
+    return i;
+}
+
+static size_t find_value_vec(const uint32_t *buf, size_t cnt, uint32_t val)
+{
+    const __m128i v = _mm_set1_epi32(val);
+    size_t i;
+
+    for (i = 0; i + VEC_WORDS <= cnt; i += VEC_WORDS) {
+        __m128i eq = _mm_and_si128(
+            _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(buf + i)), v),
+            _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(buf + i + 4)), v));
+        if (_mm_movemask_epi8(eq) != 0xFFFF)
+            break;
+    }
+    return i;
+}
+
+#else
+
+// no vector unit: everything goes through the scalar loops
+static size_t fill_vec(uint32_t *buf, size_t cnt, uint32_t pattern)
+{
+    return 0;
+}
+
+static size_t find_pattern_vec(const uint32_t *buf, size_t cnt,
+                               uint32_t pattern)
+{
+    return 0;
+}
+
+static size_t find_value_vec(const uint32_t *buf, size_t cnt, uint32_t val)
+{
+    return 0;
+}
+
+#endif
+
+void fill_pattern32(uint32_t *buf, size_t len, uint64_t off)
+{
+    size_t cnt = len / sizeof(uint32_t);
+    uint32_t pattern = (uint32_t)(off / sizeof(uint32_t));
+    size_t done = fill_vec(buf, cnt, pattern);
+
+    fill_words(buf + done, cnt - done, pattern + (uint32_t)done);
+}
+
+size_t find_pattern32_mismatch(const uint32_t *buf, size_t len, uint64_t off)
+{
+    size_t cnt = len / sizeof(uint32_t);
+    uint32_t pattern = (uint32_t)(off / sizeof(uint32_t));
+    size_t i = find_pattern_vec(buf, cnt, pattern);
+
+    i += find_pattern_words(buf + i, cnt - i, pattern + (uint32_t)i);
+    return i == cnt ? len : i * sizeof(uint32_t);
+}
+
+size_t find_value32_mismatch(const uint32_t *buf, size_t len, uint32_t val)
+{
+    size_t cnt = len / sizeof(uint32_t);
+    size_t i = find_value_vec(buf, cnt, val);
+
+    i += find_value_words(buf + i, cnt - i, val);
+    return i == cnt ? len : i * sizeof(uint32_t);
+}
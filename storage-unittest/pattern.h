@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Test data kernels. A pattern buffer for file offset off holds
+ * consecutive 32-bit words starting at off / 4, so any chunk of a file
+ * can be filled and verified on its own.
+ *
+ * NEON or SSE2 is used when the compiler targets it, the plain word loop
+ * otherwise. Only whole words are processed: tail bytes of len that do
+ * not make a word are ignored.
+ */
+#define PATTERN_VEC_WORDS  8   // words per vector step
+
+void fill_pattern32(uint32_t *buf, size_t len, uint64_t off);
+
+// Return byte offset of first word not matching pattern, or len
+size_t find_pattern32_mismatch(const uint32_t *buf, size_t len, uint64_t off);
+
+// Return byte offset of first word not equal to val, or len
+size_t find_value32_mismatch(const uint32_t *buf, size_t len, uint32_t val);
+
+static inline bool check_pattern32(const uint32_t *buf, size_t len,
+                                   uint64_t off)
+{
+    return find_pattern32_mismatch(buf, len, off) == len;
+}
+
+static inline bool check_value32(const uint32_t *buf, size_t len,
+                                 uint32_t val)
+{
+    return find_value32_mismatch(buf, len, val) == len;
+}
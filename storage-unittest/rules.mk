@@ -20,11 +20,19 @@ MODULE := $(LOCAL_DIR)
 MODULE_SRCS += \
 	$(LOCAL_DIR)/manifest.c \
 	$(LOCAL_DIR)/main.c \
+	$(LOCAL_DIR)/bench.c \
+	$(LOCAL_DIR)/io_arena.c \
+	$(LOCAL_DIR)/parallel.c \
+	$(LOCAL_DIR)/pattern.c \
 
 MODULE_DEPS += \
 	app/trusty \
 	lib/libc-trusty \
-	lib/storage
+	lib/storage \
+	app/sample/lib/memprof \
+	app/sample/lib/perf \
+	app/sample/lib/storage_ext \
+	app/sample/lib/testreg \
 
 include make/module.mk
 
@@ -24,5 +24,6 @@ MODULE_SRCS += \
 MODULE_DEPS += \
 	app/trusty \
 	lib/libc-trusty \
+	app/sample/lib/perf \
 
 include make/module.mk
@@ -19,6 +19,30 @@
 #include <stdlib.h>
 #include <string.h>
 #include <trusty_std.h>
+#include <lib/perf/perf_stats.h>
+
+/*
+ * Scheduling latency probe.
+ *
+ * Every round measures:
+ *  - how late nanosleep() wakes up compared to requested time, for a
+ *    few sleep lengths
+ *  - how much a fixed amount of busy work gets stretched: the busy loop
+ *    is cut into equal slices and every slice is compared against the
+ *    fastest one, which is taken as the undisturbed run time
+ */
+#define SLEEP_ITERATIONS  1000
+#define BUSY_ITERATIONS   100000000
+#define BUSY_SLICE        100000
+#define BUSY_SLICES       (BUSY_ITERATIONS / BUSY_SLICE)
+
+static const uint64_t sleep_ns[] = {
+	100 * 1000,
+	1000 * 1000,
+	10 * 1000 * 1000,
+};
+
+static int64_t slice_ns[BUSY_SLICES];
 
 volatile void nop(void)
 {
@@ -26,17 +50,81 @@ volatile void nop(void)
 	i++;
 }
 
+static void probe_sleep(uint64_t req_ns)
+{
+	static struct perf_stats h;
+	uint early = 0;
+	char name[32];
+	char hist[160];
+
+	perf_stats_reset(&h);
+	for (uint i = 0; i < SLEEP_ITERATIONS; i++) {
+		int64_t t0 = perf_now_ns();
+		nanosleep(0, 0, req_ns);
+		int64_t late = perf_now_ns() - t0 - (int64_t)req_ns;
+
+		if (late < 0)
+			early++;
+		perf_stats_add(&h, late);
+	}
+
+	/* early wakeups are counted as 0 ns late */
+	snprintf(name, sizeof(name), "sleep%lluus.late", req_ns / 1000);
+	perf_print_stats("timer", name, &h, "ns");
+	perf_print_value("timer", name, "early", early, "wakeups");
+
+	/* non empty buckets as "lower bound in ns:count" pairs */
+	perf_stats_hist_str(&h, hist, sizeof(hist));
+	printf("%s hist%s\n", name, hist);
+}
+
+static void probe_busy(void)
+{
+	static struct perf_stats h;
+	int64_t t0, t1, total, best;
+	uint preempted = 0;
+
+	t0 = perf_now_ns();
+	for (uint s = 0; s < BUSY_SLICES; s++) {
+		t1 = perf_now_ns();
+		for (uint i = 0; i < BUSY_SLICE; i++)
+			nop();
+		slice_ns[s] = perf_now_ns() - t1;
+	}
+	total = perf_now_ns() - t0;
+
+	best = slice_ns[0];
+	for (uint s = 1; s < BUSY_SLICES; s++)
+		best = MIN(best, slice_ns[s]);
+
+	/* anything over twice the best slice counts as preempted */
+	perf_stats_reset(&h);
+	for (uint s = 0; s < BUSY_SLICES; s++) {
+		int64_t extra = slice_ns[s] - best;
+		perf_stats_add(&h, extra);
+		if (slice_ns[s] > 2 * best)
+			preempted++;
+	}
+
+	int64_t ideal = best * BUSY_SLICES;
+	perf_print_value("timer", "busy", "total", total, "ns");
+	perf_print_value("timer", "busy", "undisturbed", ideal, "ns");
+	perf_print_value("timer", "busy", "stretch",
+			 ideal > 0 ? (total - ideal) * 1000 / ideal : 0,
+			 "permille");
+	perf_print_value("timer", "busy", "preempted", preempted, "slices");
+	perf_print_stats("timer", "busy.slice_extra", &h, "ns");
+}
+
 int main(void)
 {
-	int i;
+	uint round = 0;
+
 	while (true) {
-		printf("Hello world from timer app 1\n");
-		for (i = 0; i < 100000000; i++)
-			nop();
-		printf("Hello world from timer app 2\n");
-		for (i = 0; i < 1000; i++)
-			nanosleep(0, 0, 1000 * 1000);
-		printf("Hello world from timer app 3\n");
+		printf("timer latency probe: round %u\n", round++);
+		probe_busy();
+		for (uint i = 0; i < countof(sleep_ns); i++)
+			probe_sleep(sleep_ns[i]);
 		nanosleep(0, 0, 10ULL * 1000 * 1000 * 1000);
 	}
 	return 0;